@@ -1,4 +1,5 @@
 #include <iostream>
+#include <string>
 
 #include "board.hpp"
 
@@ -35,6 +36,14 @@ char itemToDisplay(uint8_t item) {
     }
 }
 
+uint8_t displayToItem(char display) {
+    for (const uint8_t item : {EMPTY, YELLOW, GREEN, RED, PINK, BLUE, YELLOW_BOMB, GREEN_BOMB, RED_BOMB, PINK_BOMB, BLUE_BOMB}) {
+        if (itemToDisplay(item) == display) return item;
+    }
+    std::cerr << "unhandled display: " << display << '\n';
+    throw std::runtime_error("bad display");
+}
+
 constexpr size_t CombineHash(size_t lhs, size_t rhs) {
     // stolen from boost::hash_combine https://www.boost.org/doc/libs/1_68_0/doc/html/hash/reference.html#boost.hash_combine
     return lhs^(rhs + 0x9e3779b9 + (lhs<<6) + (lhs>>2));
@@ -63,6 +72,29 @@ bool operator==(const Board& lhs, const Board& rhs) {
     return true;
 }
 
+PackedBoard pack(const Board& board) {
+    PackedBoard ret{};
+    for (uint8_t i=0; i<MAX_COLS; ++i) {
+        for (uint8_t j=0; j<board.counts[i]; ++j) {
+            ret.set(i, j, board.items[i][j]);
+        }
+    }
+    ret.setHeld(board.held);
+    return ret;
+}
+
+Board unpack(const PackedBoard& board) {
+    Board ret{};
+    for (uint8_t i=0; i<MAX_COLS; ++i) {
+        ret.counts[i] = board.count(i);
+        for (uint8_t j=0; j<ret.counts[i]; ++j) {
+            ret.items[i][j] = board.get(i, j);
+        }
+    }
+    ret.held = board.held();
+    return ret;
+}
+
 int itemCount(const Board& board) {
     int ret = 0;
     for (int i=0; i<MAX_COLS; ++i) {
@@ -86,4 +118,33 @@ void printBoard(const Board& board) {
         std::cout << '\n';
     }
 }
+
+std::optional<Board> readBoard(std::istream& in) {
+    Board board{};
+    bool ended[MAX_COLS]{};
+    for (int j=0; j<MAX_ROWS; ++j) {
+        std::string line;
+        if (!std::getline(in, line)) {
+            if (j == 0) return {};
+            throw std::runtime_error("truncated board");
+        }
+        // trailing spaces are often trimmed, so a short line is empty on the right
+        line.resize(MAX_COLS+2, ' ');
+        for (int i=0; i<MAX_COLS; ++i) {
+            const uint8_t item = displayToItem(line[i]);
+            if (item == EMPTY) {
+                ended[i] = true;
+            } else if (ended[i]) {
+                throw std::runtime_error("gap in board column");
+            } else {
+                board.items[i][j] = item;
+                ++board.counts[i];
+            }
+        }
+        if (j == 0) {
+            board.held = displayToItem(line[MAX_COLS+1]);
+        }
+    }
+    return board;
+}
 }}
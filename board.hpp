@@ -1,7 +1,14 @@
 #ifndef BOARD_HPP
 #define BOARD_HPP
 
+#include <cstddef>
 #include <cstdint>
+#include <istream>
+#include <optional>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 namespace HackMatch {
 namespace Board {
@@ -35,11 +42,96 @@ struct BoardHash {
     std::size_t operator()(const Board& board) const noexcept;
 };
 
+// Board at 4 bits per cell, column-major, with held in the last nibble.
+// Cells past a column's count are kept EMPTY, so counts are implicit and a
+// whole board is a single 256-bit value to copy, compare and hash.
+struct alignas(32) PackedBoard {
+    static const uint8_t COLUMN_BITS = MAX_ROWS*4;
+    static const uint64_t COLUMN_MASK = (uint64_t{1} << COLUMN_BITS) - 1;
+    static const uint64_t NIBBLE_LOW_BITS = 0x1111111111111111;
+    uint64_t lanes[4];
+
+    static constexpr uint8_t nibbleIndex(uint8_t col, uint8_t row) {
+        return col*MAX_ROWS + row;
+    }
+    uint8_t get(uint8_t col, uint8_t row) const {
+        const uint8_t n = nibbleIndex(col, row);
+        return (lanes[n/16] >> (n%16*4)) & 0xf;
+    }
+    void set(uint8_t col, uint8_t row, uint8_t item) {
+        const uint8_t n = nibbleIndex(col, row);
+        lanes[n/16] = (lanes[n/16] & ~(uint64_t{0xf} << (n%16*4))) | (uint64_t{item} << (n%16*4));
+    }
+    // The column's nibbles, row 0 lowest.
+    uint64_t column(uint8_t col) const {
+        const uint8_t bit = col*COLUMN_BITS;
+        const uint8_t lane = bit/64;
+        const uint8_t shift = bit%64;
+        uint64_t ret = lanes[lane] >> shift;
+        if (shift > 64-COLUMN_BITS) {
+            ret |= lanes[lane+1] << (64-shift);
+        }
+        return ret & COLUMN_MASK;
+    }
+    // Builds a board from whole columns laid out as column() returns them.
+    static PackedBoard fromColumns(const uint64_t (&columns)[MAX_COLS], uint8_t held) {
+        PackedBoard ret{};
+        for (uint8_t col=0; col<MAX_COLS; ++col) {
+            const uint8_t bit = col*COLUMN_BITS;
+            const uint8_t shift = bit%64;
+            ret.lanes[bit/64] |= columns[col] << shift;
+            if (shift > 64-COLUMN_BITS) {
+                ret.lanes[bit/64+1] |= columns[col] >> (64-shift);
+            }
+        }
+        ret.setHeld(held);
+        return ret;
+    }
+    uint8_t count(uint8_t col) const {
+        const uint64_t c = column(col);
+        return __builtin_popcountll((c | c>>1 | c>>2 | c>>3) & NIBBLE_LOW_BITS);
+    }
+    uint8_t held() const {
+        return lanes[3] >> 60;
+    }
+    void setHeld(uint8_t item) {
+        lanes[3] = (lanes[3] & ~(uint64_t{0xf} << 60)) | (uint64_t{item} << 60);
+    }
+};
+static_assert(sizeof(PackedBoard) == 32);
+static_assert(MAX_COLS*MAX_ROWS < 64);
+
+struct PackedBoardHash {
+    std::size_t operator()(const PackedBoard& board) const noexcept {
+        // independent multiply per lane, then fold the high bits down
+        const uint64_t h = (board.lanes[0] * 0x9e3779b97f4a7c15)
+                         ^ (board.lanes[1] * 0xc2b2ae3d27d4eb4f)
+                         ^ (board.lanes[2] * 0x165667b19e3779f9)
+                         ^ (board.lanes[3] * 0xd6e8feb86659fd93);
+        return h ^ (h >> 32);
+    }
+};
+
+PackedBoard pack(const Board& board);
+Board unpack(const PackedBoard& board);
+
 int itemCount(const Board& board);
 
 bool operator==(const Board& lhs, const Board& rhs);
 
+inline bool operator==(const PackedBoard& lhs, const PackedBoard& rhs) {
+#ifdef __AVX2__
+    const __m256i l = _mm256_load_si256(reinterpret_cast<const __m256i*>(lhs.lanes));
+    const __m256i r = _mm256_load_si256(reinterpret_cast<const __m256i*>(rhs.lanes));
+    return _mm256_movemask_epi8(_mm256_cmpeq_epi8(l, r)) == -1;
+#else
+    return ((lhs.lanes[0]^rhs.lanes[0]) | (lhs.lanes[1]^rhs.lanes[1]) | (lhs.lanes[2]^rhs.lanes[2]) | (lhs.lanes[3]^rhs.lanes[3])) == 0;
+#endif
+}
+
 void printBoard(const Board& board);
+// Reads a board in printBoard's format. Returns nothing at end of input.
+std::optional<Board> readBoard(std::istream& in);
 }}
 
 #endif
@@ -0,0 +1,239 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "board.hpp"
+#include "calibration.hpp"
+#include "common.hpp"
+#include "solver.hpp"
+#include "verifier.hpp"
+#include "x11_handling.hpp"
+
+namespace HackMatch {
+namespace Calibration {
+namespace {
+const int TRIALS = 4;
+const int MIN_DELAY_MS = 1;
+// the original fixed delay, which the game is known to take
+const int MAX_DELAY_MS = 17;
+const auto SAFETY_MARGIN = std::chrono::milliseconds(2);
+const auto CONFIRM_TIMEOUT = std::chrono::milliseconds(17*6);
+// a single look, for sampling while keys go in
+const auto NO_WAIT = std::chrono::milliseconds(0);
+const int TOGGLE_PRESSES = 3;
+
+// second connection to the server, so the game can be watched while keys go in
+Display* observerDisplay = nullptr;
+
+void movePhage(Display* display, uint8_t from, uint8_t to) {
+    while (to > from) {
+        X11Handling::moveRight(display);
+        ++from;
+    }
+    while (to < from) {
+        X11Handling::moveLeft(display);
+        --from;
+    }
+}
+
+// Runs to the far wall, so the same key goes in back to back.
+bool moveTrial(Display* display, Window window, const X11Handling::PhageAndBoard& start) {
+    const uint8_t target = start.phageCol < Board::MAX_COLS/2 ? Board::MAX_COLS-1 : 0;
+    movePhage(display, start.phageCol, target);
+    return Verifier::waitForState(display, window, start.board, target, false, CONFIRM_TIMEOUT);
+}
+
+// Deep enough that a new row can't change the top two, and not about to overflow.
+bool isStableColumn(const Board::Board& board, uint8_t col) {
+    return board.counts[col] >= 3 && board.counts[col] < Board::MAX_ROWS;
+}
+
+// Watches the game while a toggle trial keys in, counting each time the shown state
+// flips between the start and the toggled state. Every accepted press stays on screen
+// for at least a frame, so it's seen even when the presses go in faster than we poll.
+class ToggleObserver {
+    std::atomic<bool> done{false};
+    int flips = 0;
+    std::thread thread;
+public:
+    ToggleObserver(Window window, const Board::Board& start, const Board::Board& toggled, uint8_t col)
+        : thread([this, window, start, toggled, col]() {
+            bool shown = false;
+            bool lastToggled = false;
+            // one more look after being told to finish, so the last flip isn't missed
+            for (bool last = false; !last; ) {
+                last = done;
+                const bool isToggled = Verifier::waitForState(observerDisplay, window, toggled, col, true, NO_WAIT);
+                if (!isToggled && !Verifier::waitForState(observerDisplay, window, start, col, true, NO_WAIT)) continue;
+                if (shown && isToggled != lastToggled) ++flips;
+                shown = true;
+                lastToggled = isToggled;
+            }
+        }) {}
+    // Stops watching, and returns the number of flips seen.
+    int finish() {
+        done = true;
+        thread.join();
+        return flips;
+    }
+    ~ToggleObserver() {
+        if (thread.joinable()) finish();
+    }
+};
+
+// Three back to back presses of a key that toggles the state. Success is seeing all
+// three flips go by, so any number of dropped keys fails the trial.
+bool toggleTrial(Display* display, Window window, const X11Handling::PhageAndBoard& start, uint8_t col, Solver::Move toggle, void (*press)(Display*)) {
+    if (col != start.phageCol) {
+        movePhage(display, start.phageCol, col);
+        if (!Verifier::waitForState(display, window, start.board, col, false, CONFIRM_TIMEOUT)) return false;
+    }
+    Board::Board expected{start.board};
+    Solver::makeMove(expected, toggle);
+    ToggleObserver observer{window, start.board, expected, col};
+    for (int i=0; i<TOGGLE_PRESSES; ++i) {
+        press(display);
+    }
+    const bool ended = Verifier::waitForState(display, window, expected, col, true, CONFIRM_TIMEOUT);
+    const int flips = observer.finish();
+    if (ended && flips != TOGGLE_PRESSES) {
+        std::cout << "saw " << flips << " of " << TOGGLE_PRESSES << " toggles\n";
+    }
+    return ended && flips == TOGGLE_PRESSES;
+}
+
+// SWAPs a column whose top two differ and don't match once swapped.
+bool swapTrial(Display* display, Window window, const X11Handling::PhageAndBoard& start) {
+    for (uint8_t col=0; col<Board::MAX_COLS; ++col) {
+        const Board::Board& board = start.board;
+        if (!isStableColumn(board, col)) continue;
+        if (board.items[col][board.counts[col]-1] == board.items[col][board.counts[col]-2]) continue;
+        const Solver::Move swap{Solver::SWAP, col};
+        if (Solver::planMakesMatch(board, {swap})) continue;
+        return toggleTrial(display, window, start, col, swap, X11Handling::swap);
+    }
+    std::cout << "no column to calibrate swap on\n";
+    return false;
+}
+
+// TAKEs from, or PUTs onto, a column where the result can't match.
+bool tractorBeamTrial(Display* display, Window window, const X11Handling::PhageAndBoard& start) {
+    for (uint8_t col=0; col<Board::MAX_COLS; ++col) {
+        const Board::Board& board = start.board;
+        if (!isStableColumn(board, col)) continue;
+        const Solver::Move toggle{board.held ? Solver::PUT : Solver::TAKE, col};
+        if (board.held && Solver::planMakesMatch(board, {toggle})) continue;
+        return toggleTrial(display, window, start, col, toggle, X11Handling::tractorBeam);
+    }
+    std::cout << "no column to calibrate tractor beam on\n";
+    return false;
+}
+
+bool trial(Display* display, Window window, X11Handling::KeyAction action) {
+    const auto start = X11Handling::loadPhageAndBoardFromWindow(display, window);
+    if (!start) return false;
+    switch (action) {
+    case X11Handling::KeyAction::MOVE:
+        return moveTrial(display, window, *start);
+    case X11Handling::KeyAction::SWAP:
+        return swapTrial(display, window, *start);
+    case X11Handling::KeyAction::TRACTOR_BEAM:
+        return tractorBeamTrial(display, window, *start);
+    }
+    return false;
+}
+
+bool reliable(Display* display, Window window, X11Handling::KeyAction action) {
+    for (int i=0; i<TRIALS; ++i) {
+        if (!trial(display, window, action)) return false;
+    }
+    return true;
+}
+
+// Binary search for the shortest press (or release) delay that passes every trial.
+std::chrono::milliseconds shortestReliable(Display* display, Window window, X11Handling::KeyAction action, bool calibratingPress) {
+    int lo = MIN_DELAY_MS;
+    int hi = MAX_DELAY_MS;
+    const X11Handling::KeyTiming original = X11Handling::getKeyTiming(action);
+    while (lo < hi) {
+        const int mid = (lo+hi)/2;
+        X11Handling::KeyTiming timing = original;
+        (calibratingPress ? timing.press : timing.release) = std::chrono::milliseconds(mid);
+        X11Handling::setKeyTiming(action, timing);
+        const bool ok = reliable(display, window, action);
+        std::cout << X11Handling::keyActionName(action) << (calibratingPress ? " press " : " release ") << mid << "ms: " << (ok ? "ok" : "failed") << '\n';
+        if (ok) {
+            hi = mid;
+        } else {
+            lo = mid+1;
+        }
+    }
+    X11Handling::setKeyTiming(action, original);
+    return std::chrono::milliseconds(hi);
+}
+}
+
+void calibrate(Display* display, Window window) {
+    Timer timer{"calibrate time"};
+    observerDisplay = XOpenDisplay(nullptr);
+    if (observerDisplay == nullptr) {
+        throw std::runtime_error("failed to open display for calibration");
+    }
+    // MOVE first, the other trials move the phage into place with its result
+    for (const auto action : X11Handling::KEY_ACTIONS) {
+        X11Handling::KeyTiming timing = X11Handling::getKeyTiming(action);
+        timing.press = std::min(shortestReliable(display, window, action, true) + SAFETY_MARGIN, timing.press);
+        X11Handling::setKeyTiming(action, timing);
+        timing.release = std::min(shortestReliable(display, window, action, false) + SAFETY_MARGIN, timing.release);
+        X11Handling::setKeyTiming(action, timing);
+        std::cout << X11Handling::keyActionName(action) << " calibrated to " << timing.press.count() << "ms/" << timing.release.count() << "ms\n";
+    }
+    XCloseDisplay(observerDisplay);
+    observerDisplay = nullptr;
+}
+
+bool loadTimings(const char* path) {
+    std::ifstream in{path};
+    if (!in) return false;
+    std::vector<std::pair<X11Handling::KeyAction, X11Handling::KeyTiming>> timings;
+    std::string name;
+    int press;
+    int release;
+    while (in >> name >> press >> release) {
+        const auto action = std::find_if(std::begin(X11Handling::KEY_ACTIONS), std::end(X11Handling::KEY_ACTIONS),
+                [&name](X11Handling::KeyAction a){return name == X11Handling::keyActionName(a);});
+        if (action == std::end(X11Handling::KEY_ACTIONS) || press < MIN_DELAY_MS || release < MIN_DELAY_MS) {
+            std::cerr << "bad timing in " << path << ": " << name << '\n';
+            return false;
+        }
+        timings.push_back({*action, {std::chrono::milliseconds(press), std::chrono::milliseconds(release)}});
+    }
+    if (!in.eof()) {
+        std::cerr << "failed to parse " << path << '\n';
+        return false;
+    }
+    for (const auto& [action, timing] : timings) {
+        X11Handling::setKeyTiming(action, timing);
+        std::cout << X11Handling::keyActionName(action) << " timing " << timing.press.count() << "ms/" << timing.release.count() << "ms\n";
+    }
+    return true;
+}
+
+void saveTimings(const char* path) {
+    std::ofstream out{path};
+    for (const auto action : X11Handling::KEY_ACTIONS) {
+        const X11Handling::KeyTiming timing = X11Handling::getKeyTiming(action);
+        out << X11Handling::keyActionName(action) << ' ' << timing.press.count() << ' ' << timing.release.count() << '\n';
+    }
+    if (!out) {
+        throw std::runtime_error("failed to save timings");
+    }
+}
+}}
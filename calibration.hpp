@@ -0,0 +1,18 @@
+#ifndef CALIBRATION_HPP
+#define CALIBRATION_HPP
+
+#include <X11/Xlib.h>
+
+namespace HackMatch {
+namespace Calibration {
+const char* const TIMINGS_PATH = "hackmatch_timings.txt";
+
+// Finds the shortest press and release delays the game reliably takes for
+// each key action by keying in test sequences on the live board, and
+// installs them with X11Handling::setKeyTiming.
+void calibrate(Display* display, Window window);
+// Returns false if path is missing or malformed, leaving the timings alone.
+bool loadTimings(const char* path);
+void saveTimings(const char* path);
+}}
+#endif
@@ -1,7 +1,9 @@
 #ifndef HACKMATCH_COMMON_HPP
 #define HACKMATCH_COMMON_HPP
 
+#include <algorithm>
 #include <chrono>
+#include <cstdint>
 #include <iostream>
 
 namespace HackMatch {
@@ -15,5 +17,39 @@ public:
         std::cout << message << ": " << std::chrono::duration_cast<std::chrono::milliseconds>(t1-t0).count() << '\n';
     }
 };
+
+// Durations in power of two microsecond buckets, for watching the tail rather than the mean.
+class LatencyHistogram {
+    static const int BUCKETS = 24;
+    uint64_t counts[BUCKETS]{};
+    uint64_t total = 0;
+    std::chrono::microseconds max{0};
+
+    // smallest bucket bound with at least fraction of the samples at or below it
+    std::chrono::microseconds percentile(double fraction) const {
+        uint64_t seen = 0;
+        for (int i=0; i<BUCKETS; ++i) {
+            seen += counts[i];
+            if (seen >= fraction*total) return std::min(std::chrono::microseconds(uint64_t{1} << i), max);
+        }
+        return max;
+    }
+public:
+    void record(std::chrono::nanoseconds duration) {
+        const auto us = std::chrono::duration_cast<std::chrono::microseconds>(duration);
+        int bucket = 0;
+        while (bucket+1 < BUCKETS && (int64_t{1} << bucket) < us.count()) ++bucket;
+        ++counts[bucket];
+        ++total;
+        if (us > max) max = us;
+    }
+    void print(const char* name) const {
+        std::cout << name << " latency us: n=" << total
+                  << " p50<=" << percentile(0.5).count()
+                  << " p99<=" << percentile(0.99).count()
+                  << " p99.9<=" << percentile(0.999).count()
+                  << " max=" << max.count() << '\n';
+    }
+};
 }
 #endif
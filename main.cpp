@@ -1,11 +1,16 @@
-//clang++ -O3 -Wall -Werror -Wextra -std=c++17 board.cpp x11_handling.cpp solver.cpp main.cpp -lX11 -lXtst
+//clang++ -O3 -march=native -Wall -Werror -Wextra -std=c++17 -pthread board.cpp x11_handling.cpp solver.cpp calibration.cpp realtime.cpp speculation.cpp verifier.cpp main.cpp -lX11 -lXtst
 
+#include <algorithm>
 #include <cassert>
+#include <charconv>
 #include <chrono>
 #include <cstring>
+#include <fstream>
 #include <iostream>
 #include <optional>
+#include <string>
 #include <thread>
+#include <utility>
 #include <vector>
 
 #include <X11/X.h>
@@ -15,54 +20,157 @@
 
 #include "x11_handling.hpp"
 #include "board.hpp"
+#include "calibration.hpp"
+#include "common.hpp"
+#include "realtime.hpp"
 #include "solver.hpp"
+#include "speculation.hpp"
+#include "verifier.hpp"
 
-int main(int, char**) {
+namespace {
+using namespace HackMatch;
+
+// plans between latency reports
+const int LATENCY_REPORT_INTERVAL = 200;
+
+// A comma separated list of at most two cpu numbers, or nothing if it isn't one.
+std::optional<std::vector<int>> parseCpus(const std::string& list) {
+    std::vector<int> cpus;
+    std::size_t start = 0;
+    while (cpus.size() < 2) {
+        const std::size_t end = std::min(list.find(',', start), list.size());
+        int cpu;
+        const auto [last, error] = std::from_chars(list.data()+start, list.data()+end, cpu);
+        if (error != std::errc{} || last != list.data()+end || cpu < 0) break;
+        cpus.push_back(cpu);
+        if (end == list.size()) return cpus;
+        start = end+1;
+    }
+    return {};
+}
+
+void printUsage(const char* name) {
+    std::cerr << "usage: " << name << " [--score] [--calibrate] [--frontier] [--low-latency [--cpus capture,solve]] [--bench boards.txt]\n";
+}
+
+// Solves every board in a file of printBoard output with each engine.
+int bench(const char* path) {
+    std::ifstream in{path};
+    if (!in) {
+        std::cerr << "failed to open " << path << '\n';
+        return 1;
+    }
+    std::vector<Board::Board> boards;
+    while (const auto board = Board::readBoard(in)) {
+        boards.push_back(*board);
+    }
+    std::vector<Solver::Move> moves;
+    moves.reserve(100);
+    for (const auto& [engine, name] : {std::pair{Solver::Engine::DEPTH_FIRST, "depth first"}, std::pair{Solver::Engine::FRONTIER, "frontier"}}) {
+        Solver::setEngine(engine);
+        int matched = 0;
+        std::size_t totalMoves = 0;
+        const auto t0 = std::chrono::high_resolution_clock::now();
+        for (const auto& board : boards) {
+            Solver::solve(board, moves);
+            matched += Solver::planMakesMatch(board, moves);
+            totalMoves += moves.size();
+        }
+        const auto t1 = std::chrono::high_resolution_clock::now();
+        std::cout << name << ": " << boards.size() << " boards, " << matched << " matched, "
+                  << totalMoves << " moves, " << std::chrono::duration_cast<std::chrono::milliseconds>(t1-t0).count() << "ms\n";
+    }
+    return 0;
+}
+}
+
+int main(int argc, char** argv) {
+    Solver::Objective objective = Solver::Objective::SURVIVE;
+    bool calibrate = false;
+    bool lowLatency = false;
+    std::vector<int> cpus;
+    for (int i=1; i<argc; ++i) {
+        if (!strcmp(argv[i], "--score")) {
+            objective = Solver::Objective::SCORE;
+        } else if (!strcmp(argv[i], "--calibrate")) {
+            calibrate = true;
+        } else if (!strcmp(argv[i], "--frontier")) {
+            Solver::setEngine(Solver::Engine::FRONTIER);
+        } else if (!strcmp(argv[i], "--bench") && i+1 < argc) {
+            return bench(argv[i+1]);
+        } else if (!strcmp(argv[i], "--low-latency")) {
+            lowLatency = true;
+        } else if (!strcmp(argv[i], "--cpus") && i+1 < argc) {
+            const auto parsed = parseCpus(argv[++i]);
+            if (!parsed) {
+                std::cerr << "bad cpu list: " << argv[i] << '\n';
+                printUsage(argv[0]);
+                return 1;
+            }
+            cpus = *parsed;
+        } else {
+            std::cerr << "unknown argument: " << argv[i] << '\n';
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (!cpus.empty() && !lowLatency) {
+        std::cerr << "--cpus needs --low-latency\n";
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (lowLatency) {
+        Realtime::enterLowLatencyMode(cpus);
+    }
+    if (calibrate) {
+        // calibration watches the game from a second thread
+        XInitThreads();
+    }
     Display *display = XOpenDisplay(nullptr);
     if (display == nullptr) {
         std::cerr << "failed to open display\n";
         return 1;
     }
-    using namespace HackMatch;
     Window window = X11Handling::getExapunksWindow(display);
     X11Handling::validateAssumptions(display, window);
     X11Handling::activateWindow(display, window);
+    if (calibrate) {
+        Calibration::calibrate(display, window);
+        Calibration::saveTimings(Calibration::TIMINGS_PATH);
+    } else if (!Calibration::loadTimings(Calibration::TIMINGS_PATH)) {
+        std::cout << "no key timings in " << Calibration::TIMINGS_PATH << ", using defaults\n";
+    }
     std::vector<Solver::Move> moves;
     moves.reserve(100);
+    Speculation::Speculator speculator{objective};
+    LatencyHistogram captureLatency;
+    LatencyHistogram solveLatency;
+    int plans = 0;
     while (true) {
+        const auto t0 = std::chrono::steady_clock::now();
         std::optional<X11Handling::PhageAndBoard> phageAndBoard = X11Handling::loadPhageAndBoardFromWindow(display, window);
+        const auto t1 = std::chrono::steady_clock::now();
+        captureLatency.record(t1 - t0);
         if (!phageAndBoard) {
             continue;
         }
         printBoard(phageAndBoard->board);
-        Solver::solve(phageAndBoard->board, moves);
+        const auto t2 = std::chrono::steady_clock::now();
+        if (!speculator.take(phageAndBoard->board, moves)) {
+            Realtime::OrdinaryPriority ordinary;
+            Solver::solveWithObjective(objective, phageAndBoard->board, phageAndBoard->phageCol, moves);
+        }
+        solveLatency.record(std::chrono::steady_clock::now() - t2);
         Solver::printMoves(moves);
-        uint8_t phageCol = phageAndBoard->phageCol;
-        for (const auto& move : moves) {
-            while (move.col > phageCol) {
-                X11Handling::moveRight(display);
-                ++phageCol;
-            }
-            while (move.col < phageCol) {
-                X11Handling::moveLeft(display);
-                --phageCol;
-            }
-            switch (move.command) {
-            case Solver::PUT:
-                X11Handling::tractorBeam(display);
-                break;
-            case Solver::TAKE:
-                X11Handling::tractorBeam(display);
-                break;
-            case Solver::SWAP:
-                X11Handling::swap(display);
-                break;
-            default:
-                std::cerr << "bad command in solution: " << static_cast<int>(move.command) << '\n';
-                throw std::runtime_error("bad command in solution");
-            }
+        if (++plans % LATENCY_REPORT_INTERVAL == 0) {
+            captureLatency.print("capture");
+            solveLatency.print("solve");
+            X11Handling::sendKeyOvershoot().print("sendKey overshoot");
+        }
+        speculator.start(phageAndBoard->board, moves);
+        if (!Verifier::executePlan(display, window, phageAndBoard->board, phageAndBoard->phageCol, moves)) {
+            std::cout << "plan not confirmed\n";
         }
-        std::this_thread::sleep_for(std::chrono::milliseconds(17*4+3));
     }
     return 0;
 }
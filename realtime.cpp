@@ -0,0 +1,148 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "common.hpp"
+#include "realtime.hpp"
+
+namespace HackMatch {
+namespace Realtime {
+namespace {
+// comfortably more than the solver caches and screenshots need at once
+const std::size_t PREFAULT_HEAP_BYTES = 64 << 20;
+const std::size_t PREFAULT_STACK_BYTES = 512 << 10;
+// just above normal threads, we only need to beat the desktop, not the kernel
+const int CAPTURE_PRIORITY = 1;
+
+bool enabled = false;
+// whether the capture thread got SCHED_FIFO, to restore after OrdinaryPriority
+bool fifo = false;
+int solverCpu = -1;
+
+bool pinThread(int cpu) {
+    if (cpu >= CPU_SETSIZE) {
+        std::cerr << "failed to pin thread to cpu " << cpu << ": past CPU_SETSIZE\n";
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    const int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (error) {
+        std::cerr << "failed to pin thread to cpu " << cpu << ": " << strerror(error) << '\n';
+        return false;
+    }
+    return true;
+}
+
+bool setOrdinaryPriority() {
+    sched_param param{};
+    const int error = pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+    if (error) {
+        std::cerr << "failed to set SCHED_OTHER: " << strerror(error) << '\n';
+        return false;
+    }
+    return true;
+}
+
+// keep freed memory in one resident heap instead of handing it back to the kernel,
+// so screenshots and solver caches reuse the pages prefaulted below
+void keepHeapResident() {
+    mallopt(M_ARENA_MAX, 1);
+    mallopt(M_MMAP_MAX, 0);
+    mallopt(M_TRIM_THRESHOLD, -1);
+}
+
+bool prefaultHeap() {
+    char* heap = static_cast<char*>(malloc(PREFAULT_HEAP_BYTES));
+    if (heap == nullptr) {
+        std::cerr << "failed to prefault heap\n";
+        return false;
+    }
+    memset(heap, 0, PREFAULT_HEAP_BYTES);
+    free(heap);
+    return true;
+}
+
+// Locks what has been faulted in so far. Only MCL_CURRENT: with MCL_FUTURE every
+// later allocation past RLIMIT_MEMLOCK would fail, where now it's merely unlocked.
+// Tried even under a small limit, which CAP_IPC_LOCK overrides.
+void lockMemory() {
+    if (mlockall(MCL_CURRENT) == 0) return;
+    const int error = errno;
+    // don't keep whatever part of the address space got locked before it failed
+    munlockall();
+    std::cerr << "failed to mlockall: " << strerror(error);
+    rlimit limit{};
+    if (error == ENOMEM && getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+        std::cerr << ", RLIMIT_MEMLOCK is " << (limit.rlim_cur >> 10) << "KB and the heap alone is "
+                  << (PREFAULT_HEAP_BYTES >> 20) << "MB; raise it with ulimit -l";
+    }
+    std::cerr << ", continuing unlocked\n";
+}
+
+__attribute__((noinline)) void prefaultStack() {
+    char stack[PREFAULT_STACK_BYTES];
+    memset(stack, 0, sizeof(stack));
+    // keep the writes from being optimised away
+    asm volatile("" : : "r"(stack) : "memory");
+}
+}
+
+void enterLowLatencyMode(const std::vector<int>& cpus) {
+    Timer timer{"enterLowLatencyMode time"};
+    enabled = true;
+    keepHeapResident();
+    // lock only a heap we know is all there
+    const bool prefaulted = prefaultHeap();
+    prefaultStack();
+    if (prefaulted) {
+        lockMemory();
+    }
+    if (!cpus.empty()) {
+        pinThread(cpus[0]);
+    }
+    // with a single cpu the solver is left unpinned, rather than sharing it with capture
+    if (cpus.size() > 1) {
+        solverCpu = cpus[1];
+    }
+    sched_param param{};
+    param.sched_priority = CAPTURE_PRIORITY;
+    const int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (error) {
+        std::cerr << "failed to set SCHED_FIFO: " << strerror(error) << ", needs CAP_SYS_NICE or an rtprio limit\n";
+    }
+    fifo = !error;
+}
+
+void configureSolverThread() {
+    if (!enabled) return;
+    if (fifo) {
+        setOrdinaryPriority();
+    }
+    if (solverCpu >= 0) {
+        pinThread(solverCpu);
+    }
+    prefaultStack();
+}
+
+OrdinaryPriority::OrdinaryPriority() : lowered(fifo && setOrdinaryPriority()) {}
+
+OrdinaryPriority::~OrdinaryPriority() {
+    if (!lowered) return;
+    sched_param param{};
+    param.sched_priority = CAPTURE_PRIORITY;
+    const int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (error) {
+        std::cerr << "failed to restore SCHED_FIFO: " << strerror(error) << '\n';
+    }
+}
+}}
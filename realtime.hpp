@@ -0,0 +1,27 @@
+#ifndef REALTIME_HPP
+#define REALTIME_HPP
+
+#include <vector>
+
+namespace HackMatch {
+namespace Realtime {
+// Opt in low latency mode, called from the main thread before any other
+// thread starts. Locks and prefaults memory, moves the calling thread (which
+// captures and sends keys) to cpus[0] under SCHED_FIFO where permitted, and
+// leaves cpus[1], if given, for solving. Failures are reported, not fatal.
+void enterLowLatencyMode(const std::vector<int>& cpus);
+// Called at the start of each solver thread, which would otherwise inherit
+// SCHED_FIFO from the capture thread. Puts it back to SCHED_OTHER, on cpus[1]
+// if one was given. Does nothing unless low latency mode is on.
+void configureSolverThread();
+
+// Drops the capture thread to SCHED_OTHER while it solves a board speculation
+// missed, since a long solve under SCHED_FIFO can starve the game and desktop.
+class OrdinaryPriority {
+    bool lowered;
+public:
+    OrdinaryPriority();
+    ~OrdinaryPriority();
+};
+}}
+#endif
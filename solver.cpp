@@ -1,8 +1,11 @@
 #include <algorithm>
+#include <array>
 #include <cassert>
 #include <chrono>
+#include <cstdlib>
 #include <iostream>
-#include <unordered_set>
+#include <unordered_map>
+#include <vector>
 
 #include "board.hpp"
 #include "common.hpp"
@@ -12,83 +15,619 @@ namespace HackMatch {
 namespace Solver {
 namespace {
 
-using CacheType = std::unordered_set<Board::Board, Board::BoardHash>;
+// set once at startup, before any speculative solve
+Engine engine = Engine::DEPTH_FIRST;
 
-template <typename T>
-bool hasMatchImpl(const Board::Board& board, uint8_t i, uint8_t j, uint8_t item, T& visited, uint8_t& matchesRemaining) {
+// Open addressing set holding the packed boards inline, so each probe is one
+// aligned 256-bit compare. The all-zero board (nothing on the board, nothing
+// held) marks a free slot and is tracked separately.
+class CacheType {
+    std::vector<Board::PackedBoard> slots;
+    std::size_t used = 0;
+    bool hasZero = false;
+
+    bool insertSlot(const Board::PackedBoard& board) {
+        const std::size_t mask = slots.size()-1;
+        for (std::size_t i=Board::PackedBoardHash{}(board) & mask; ; i=(i+1) & mask) {
+            if (slots[i] == board) return false;
+            if (slots[i] == Board::PackedBoard{}) {
+                slots[i] = board;
+                return true;
+            }
+        }
+    }
+
+    void grow() {
+        std::vector<Board::PackedBoard> old(slots.size()*2);
+        old.swap(slots);
+        for (const auto& board : old) {
+            if (!(board == Board::PackedBoard{})) insertSlot(board);
+        }
+    }
+public:
+    explicit CacheType(std::size_t capacity) {
+        std::size_t size = 1;
+        while (size < 2*capacity) size *= 2;
+        slots.resize(size);
+    }
+    void clear() {
+        std::fill(slots.begin(), slots.end(), Board::PackedBoard{});
+        used = 0;
+        hasZero = false;
+    }
+    std::size_t size() const {
+        return used;
+    }
+    // Returns false if board was already present.
+    bool insert(const Board::PackedBoard& board) {
+        if (board == Board::PackedBoard{}) {
+            if (hasZero) return false;
+            hasZero = true;
+            ++used;
+            return true;
+        }
+        if (2*(used+1) > slots.size()) grow();
+        if (!insertSlot(board)) return false;
+        ++used;
+        return true;
+    }
+};
+
+uint8_t itemAt(const Board::Board& board, uint8_t i, uint8_t j) {
+    return board.items[i][j];
+}
+
+uint8_t itemAt(const Board::PackedBoard& board, uint8_t i, uint8_t j) {
+    return board.get(i, j);
+}
+
+template <typename B, typename T>
+bool hasMatchImpl(const B& board, const uint8_t* counts, uint8_t i, uint8_t j, uint8_t item, T& visited, uint8_t& matchesRemaining) {
     if (i>=Board::MAX_COLS) return false;
-    if (j>=board.counts[i]) return false;
+    if (j>=counts[i]) return false;
     if (visited[i][j]) return false;
-    if (board.items[i][j] != item) return false;
+    if (itemAt(board, i, j) != item) return false;
     visited[i][j] = true;
     --matchesRemaining;
     if (matchesRemaining==0) return true;
-    if (hasMatchImpl(board, i+1, j, item, visited, matchesRemaining)) return true;
-    if (hasMatchImpl(board, i-1, j, item, visited, matchesRemaining)) return true;
-    if (hasMatchImpl(board, i, j+1, item, visited, matchesRemaining)) return true;
-    if (hasMatchImpl(board, i, j-1, item, visited, matchesRemaining)) return true;
+    if (hasMatchImpl(board, counts, i+1, j, item, visited, matchesRemaining)) return true;
+    if (hasMatchImpl(board, counts, i-1, j, item, visited, matchesRemaining)) return true;
+    if (hasMatchImpl(board, counts, i, j+1, item, visited, matchesRemaining)) return true;
+    if (hasMatchImpl(board, counts, i, j-1, item, visited, matchesRemaining)) return true;
     return false;
 }
 
-bool hasMatch(const Board::Board& board, uint8_t i, uint8_t j) {
+template <typename B>
+bool hasMatch(const B& board, const uint8_t* counts, uint8_t i, uint8_t j) {
     bool visited[Board::MAX_COLS][Board::MAX_ROWS]{};
-    uint8_t matchesRemaining = Board::isBomb(board.items[i][j]) ? 2 : 4;
-    return hasMatchImpl(board, i, j, board.items[i][j], visited, matchesRemaining);
+    const uint8_t item = itemAt(board, i, j);
+    uint8_t matchesRemaining = Board::isBomb(item) ? 2 : 4;
+    return hasMatchImpl(board, counts, i, j, item, visited, matchesRemaining);
+}
+
+bool hasMatch(const Board::Board& board, uint8_t i, uint8_t j) {
+    return hasMatch(board, board.counts, i, j);
+}
+
+uint8_t matchSize(const Board::Board& board, uint8_t i, uint8_t j, uint8_t item, bool (&component)[Board::MAX_COLS][Board::MAX_ROWS]) {
+    if (i>=Board::MAX_COLS) return 0;
+    if (j>=board.counts[i]) return 0;
+    if (component[i][j]) return 0;
+    if (board.items[i][j] != item) return 0;
+    component[i][j] = true;
+    return 1 + matchSize(board, i+1, j, item, component)
+             + matchSize(board, i-1, j, item, component)
+             + matchSize(board, i, j+1, item, component)
+             + matchSize(board, i, j-1, item, component);
 }
 
-bool solveImpl(const Board::Board& board, std::vector<Move>& moves, const uint8_t maxMoves, CacheType& cache) {
+// makeMove for the solver's packed boards. counts are the column counts before the move.
+void makePackedMove(Board::PackedBoard& board, const uint8_t* counts, Move move) {
+    const uint8_t col = move.col;
+    switch (move.command) {
+    case TAKE:
+        board.setHeld(board.get(col, counts[col]-1));
+        board.set(col, counts[col]-1, Board::EMPTY);
+        return;
+    case PUT:
+        board.set(col, counts[col], board.held());
+        board.setHeld(Board::EMPTY);
+        return;
+    case SWAP: {
+        const uint8_t top = board.get(col, counts[col]-1);
+        board.set(col, counts[col]-1, board.get(col, counts[col]-2));
+        board.set(col, counts[col]-2, top);
+        return;
+    }
+    }
+}
+
+// Bit per item with enough cells on the board and in hand to ever match.
+// Moves never add or remove cells, so this holds for the whole search.
+uint16_t matchableItems(const Board::Board& board) {
+    uint8_t total[16]{};
+    for (uint8_t i=0; i<Board::MAX_COLS; ++i) {
+        for (uint8_t j=0; j<board.counts[i]; ++j) {
+            ++total[board.items[i][j]];
+        }
+    }
+    ++total[board.held];
+    uint16_t ret = 0;
+    for (uint8_t item=1; item<16; ++item) {
+        if (total[item] >= (Board::isBomb(item) ? 2 : 4)) {
+            ret |= 1 << item;
+        }
+    }
+    return ret;
+}
+
+bool solveImpl(const Board::PackedBoard& board, std::vector<Move>& moves, const uint8_t maxMoves, CacheType& cache, const std::atomic<bool>* abort) {
+    if (abort && abort->load(std::memory_order_relaxed)) return false;
     if (moves.size() == maxMoves) return false;
-    const auto cacheRet = cache.insert(board);
-    if (!cacheRet.second) return false;
+    if (!cache.insert(board)) return false;
+    uint8_t counts[Board::MAX_COLS];
+    for (uint8_t i=0; i<Board::MAX_COLS; ++i) {
+        counts[i] = board.count(i);
+    }
     uint8_t cols[Board::MAX_COLS] = {0, 1, 2, 3, 4, 5, 6};
-    if (board.held) {
-        std::sort(cols, cols+Board::MAX_COLS, [&board](uint8_t l, uint8_t r){
-                return board.counts[l] < board.counts[r];});
+    if (board.held()) {
+        std::sort(cols, cols+Board::MAX_COLS, [&counts](uint8_t l, uint8_t r){
+                return counts[l] < counts[r];});
         for (uint8_t colIndex=0; colIndex<Board::MAX_COLS; ++colIndex) {
             const uint8_t i = cols[colIndex];
-            if (board.counts[i] < Board::MAX_ROWS) {
-                Board::Board curBoard{board};
+            if (counts[i] < Board::MAX_ROWS) {
+                Board::PackedBoard curBoard{board};
                 moves.push_back({PUT, i});
-                makeMove(curBoard, moves.back());
-                if (hasMatch(curBoard, i, curBoard.counts[i]-1)) {
+                makePackedMove(curBoard, counts, moves.back());
+                ++counts[i];
+                const bool matched = hasMatch(curBoard, counts, i, counts[i]-1);
+                --counts[i];
+                if (matched) {
                     return true;
                 }
-                if (solveImpl(curBoard, moves, maxMoves, cache)) return true;
+                if (solveImpl(curBoard, moves, maxMoves, cache, abort)) return true;
                 moves.pop_back();
             }
         }
     } else {
-        std::sort(cols, cols+Board::MAX_COLS, [&board](uint8_t l, uint8_t r){
-                return board.counts[l] > board.counts[r];});
+        std::sort(cols, cols+Board::MAX_COLS, [&counts](uint8_t l, uint8_t r){
+                return counts[l] > counts[r];});
         for (uint8_t colIndex=0; colIndex<Board::MAX_COLS; ++colIndex) {
             const uint8_t i = cols[colIndex];
-            if (board.counts[i] > 0) {
-                Board::Board curBoard{board};
+            if (counts[i] > 0) {
+                Board::PackedBoard curBoard{board};
                 moves.push_back({TAKE, i});
-                makeMove(curBoard, moves.back());
-                if (solveImpl(curBoard, moves, maxMoves, cache)) return true;
+                makePackedMove(curBoard, counts, moves.back());
+                if (solveImpl(curBoard, moves, maxMoves, cache, abort)) return true;
                 moves.pop_back();
             }
         }
     }
     for (uint8_t i=0; i<Board::MAX_COLS; ++i) {
-        if (board.counts[i] > 1) {
-            Board::Board curBoard{board};
+        if (counts[i] > 1) {
+            Board::PackedBoard curBoard{board};
             moves.push_back({SWAP, i});
-            makeMove(curBoard, moves.back());
-            if (hasMatch(curBoard, i, curBoard.counts[i]-1)) {
+            makePackedMove(curBoard, counts, moves.back());
+            if (hasMatch(curBoard, counts, i, counts[i]-1)) {
                 return true;
             }
-            if (hasMatch(curBoard, i, curBoard.counts[i]-2)) {
+            if (hasMatch(curBoard, counts, i, counts[i]-2)) {
                 return true;
             }
-            if (solveImpl(curBoard, moves, maxMoves, cache)) return true;
+            if (solveImpl(curBoard, moves, maxMoves, cache, abort)) return true;
             moves.pop_back();
         }
     }
     return false;
 }
 
+// Score mode weights. The game doesn't publish its scoring, so these favour
+// what it visibly rewards: big clears (bomb wipes included) and a lower stack.
+const int SCORE_MAX_MOVES = 5;
+const double CLEARED_WEIGHT = 1.0;
+const double HEIGHT_REDUCTION_WEIGHT = 4.0;
+const double DANGER_WEIGHT = 3.0;
+const uint8_t SAFE_HEIGHT = 6;
+// Each key is held and released for 17ms, and the board settles for 71ms after a plan.
+const double KEY_SECONDS = 0.034;
+const double SETTLE_SECONDS = 0.071;
+
+uint8_t maxCount(const Board::Board& board) {
+    return *std::max_element(board.counts, board.counts+Board::MAX_COLS);
+}
+
+// How close the columns are to overflowing.
+int danger(const Board::Board& board) {
+    int ret = 0;
+    for (uint8_t i=0; i<Board::MAX_COLS; ++i) {
+        if (board.counts[i] > SAFE_HEIGHT) {
+            const int over = board.counts[i] - SAFE_HEIGHT;
+            ret += over*over;
+        }
+    }
+    return ret;
+}
+
+double planSeconds(int keys) {
+    return keys*KEY_SECONDS + SETTLE_SECONDS;
+}
+
+struct ScoreSearch {
+    const std::atomic<bool>* const abort;
+    const uint8_t startHeight;
+    const int startDanger;
+    // Per board and phage column, the keys and depth it was last expanded at.
+    // Where it ends up only depends on those, so a visit with no fewer keys
+    // and no more moves left can't do better.
+    struct Visit {
+        uint8_t keys = UINT8_MAX;
+        uint8_t depth = UINT8_MAX;
+    };
+    std::unordered_map<Board::PackedBoard, std::array<Visit, Board::MAX_COLS>, Board::PackedBoardHash> visited;
+    std::size_t nodes = 0;
+    std::vector<Move> bestMoves;
+    double bestRate = 0;
+    double bestSeconds = 0;
+    ScoreSearch(const Board::Board& board, const std::atomic<bool>* abort)
+        : abort(abort), startHeight(maxCount(board)), startDanger(danger(board)) {
+        visited.reserve(1<<14);
+    }
+};
+
+// Value of a plan, from the board it leaves after clearing: the clear itself,
+// and how much lower and further from overflowing the stack is than at the
+// start. A plan that leaves the stack worse off than its clear makes up for is
+// worth nothing rather than less, so it can't gain by taking longer.
+double clearValue(const Board::PackedBoard& matched, const ScoreSearch& search) {
+    Board::Board board = Board::unpack(matched);
+    const int cleared = clearMatches(board);
+    const double value = CLEARED_WEIGHT*cleared*cleared
+                       + HEIGHT_REDUCTION_WEIGHT*(search.startHeight - maxCount(board))
+                       + DANGER_WEIGHT*(search.startDanger - danger(board));
+    return std::max(0.0, value);
+}
+
+void scoreMatch(const Board::PackedBoard& matched, const std::vector<Move>& moves, uint8_t keys, ScoreSearch& search) {
+    const double seconds = planSeconds(keys);
+    const double rate = clearValue(matched, search) / seconds;
+    if (search.bestMoves.empty() || rate > search.bestRate || (rate == search.bestRate && seconds < search.bestSeconds)) {
+        search.bestRate = rate;
+        search.bestSeconds = seconds;
+        search.bestMoves = moves;
+    }
+}
+
+// Like solveImpl, but keeps searching past the first match for the best points per second.
+void scoreImpl(const Board::PackedBoard& board, std::vector<Move>& moves, uint8_t phageCol, uint8_t keys, ScoreSearch& search) {
+    if (search.abort && search.abort->load(std::memory_order_relaxed)) return;
+    if (moves.size() == SCORE_MAX_MOVES) return;
+    ScoreSearch::Visit& visit = search.visited[board][phageCol];
+    if (visit.keys <= keys && visit.depth <= moves.size()) return;
+    visit = {keys, static_cast<uint8_t>(moves.size())};
+    ++search.nodes;
+    uint8_t counts[Board::MAX_COLS];
+    for (uint8_t i=0; i<Board::MAX_COLS; ++i) {
+        counts[i] = board.count(i);
+    }
+    for (uint8_t i=0; i<Board::MAX_COLS; ++i) {
+        const uint8_t moveKeys = keys + std::abs(i - phageCol) + 1;
+        if (board.held() && counts[i] < Board::MAX_ROWS) {
+            Board::PackedBoard curBoard{board};
+            moves.push_back({PUT, i});
+            makePackedMove(curBoard, counts, moves.back());
+            ++counts[i];
+            if (hasMatch(curBoard, counts, i, counts[i]-1)) {
+                scoreMatch(curBoard, moves, moveKeys, search);
+            } else {
+                scoreImpl(curBoard, moves, i, moveKeys, search);
+            }
+            --counts[i];
+            moves.pop_back();
+        }
+        if (!board.held() && counts[i] > 0) {
+            Board::PackedBoard curBoard{board};
+            moves.push_back({TAKE, i});
+            makePackedMove(curBoard, counts, moves.back());
+            scoreImpl(curBoard, moves, i, moveKeys, search);
+            moves.pop_back();
+        }
+        if (counts[i] > 1) {
+            Board::PackedBoard curBoard{board};
+            moves.push_back({SWAP, i});
+            makePackedMove(curBoard, counts, moves.back());
+            if (hasMatch(curBoard, counts, i, counts[i]-1) || hasMatch(curBoard, counts, i, counts[i]-2)) {
+                scoreMatch(curBoard, moves, moveKeys, search);
+            } else {
+                scoreImpl(curBoard, moves, i, moveKeys, search);
+            }
+            moves.pop_back();
+        }
+    }
+}
+
+// Frontier search: expands one ply at a time over every board at that depth,
+// held as a structure of arrays. Each move is applied to the whole frontier in
+// passes whose bodies are straight line code on 64 bit words, which GCC
+// vectorizes across boards when AVX2 is enabled (-march=native in the build line).
+
+// Beyond this many boards in a ply the search gives up, as the DFS would by running out of depth.
+const std::size_t MAX_FRONTIER = 1<<16;
+const uint64_t COLUMN_NIBBLES = Board::PackedBoard::NIBBLE_LOW_BITS & Board::PackedBoard::COLUMN_MASK;
+const uint64_t LOW_NIBBLES = 0x0f0f0f0f0f0f0f0f;
+
+// Sum of the nibbles of bits, for sums below 256.
+uint64_t nibbleSum(uint64_t bits) {
+    uint64_t sum = (bits & LOW_NIBBLES) + ((bits >> 4) & LOW_NIBBLES);
+    sum += sum >> 8;
+    sum += sum >> 16;
+    sum += sum >> 32;
+    return sum & 0xff;
+}
+
+// Cells are addressed by a bit at their nibble's low bit rather than by row, so
+// nothing below shifts by a per board amount, which the vectorizer can't do
+// across the mixed widths a row index brings in.
+
+// One bit for every cell that isn't EMPTY, contiguous from row 0.
+uint64_t occupiedNibbles(uint64_t column) {
+    return (column | column>>1 | column>>2 | column>>3) & COLUMN_NIBBLES;
+}
+
+// The whole nibble under each of nibbleBits.
+uint64_t nibbleMask(uint64_t nibbleBits) {
+    return (nibbleBits << 4) - nibbleBits;
+}
+
+uint64_t broadcastNibble(uint64_t item) {
+    uint64_t ret = item | item<<4;
+    ret |= ret<<8;
+    ret |= ret<<16;
+    return ret | ret<<32;
+}
+
+// The item in the single cell at nibbleBit.
+uint64_t nibbleAt(uint64_t column, uint64_t nibbleBit) {
+    return nibbleSum(column & nibbleMask(nibbleBit));
+}
+
+// One bit for every cell holding item.
+uint64_t equalNibbles(uint64_t column, uint64_t item) {
+    const uint64_t x = column ^ broadcastNibble(item);
+    return ~(x | x>>1 | x>>2 | x>>3) & COLUMN_NIBBLES;
+}
+
+struct Frontier {
+    std::vector<uint64_t> columns[Board::MAX_COLS];
+    std::vector<uint64_t> held;
+    // index into the previous ply, and the move that led here
+    std::vector<uint32_t> parent;
+    std::vector<Move> moves;
+
+    std::size_t size() const {
+        return held.size();
+    }
+    void push(const uint64_t (&boardColumns)[Board::MAX_COLS], uint8_t boardHeld, uint32_t boardParent, Move move) {
+        for (uint8_t i=0; i<Board::MAX_COLS; ++i) {
+            columns[i].push_back(boardColumns[i]);
+        }
+        held.push_back(boardHeld);
+        parent.push_back(boardParent);
+        moves.push_back(move);
+    }
+};
+
+// Result of applying one move to every board in a frontier. Every field is a
+// full word so the passes over it don't mix element widths.
+struct Batch {
+    std::vector<uint64_t> column;
+    std::vector<uint64_t> held;
+    std::vector<uint64_t> valid;
+    // cells the move changed, to grow matches from
+    std::vector<uint64_t> seeds[2];
+    std::vector<uint64_t> matched;
+
+    void resize(std::size_t n) {
+        column.resize(n);
+        held.resize(n);
+        valid.resize(n);
+        seeds[0].resize(n);
+        seeds[1].resize(n);
+        matched.resize(n);
+    }
+};
+
+// The arrays of a pass never overlap, which saves gcc's vectorizer its run time
+// alias checks. clang doesn't know the pragma and warns under -Wall.
+#if defined(__GNUC__) && !defined(__clang__)
+#define NO_ALIAS_LOOP _Pragma("GCC ivdep")
+#else
+#define NO_ALIAS_LOOP
+#endif
+
+// Applies command at col to every board. The command is a template parameter
+// so the loop body is straight line code.
+template <uint8_t command>
+void applyMove(const Frontier& frontier, const uint8_t col, Batch& batch) {
+    const std::size_t n = frontier.size();
+    const uint64_t* __restrict__ columns = frontier.columns[col].data();
+    const uint64_t* __restrict__ held = frontier.held.data();
+    uint64_t* __restrict__ column = batch.column.data();
+    uint64_t* __restrict__ newHeld = batch.held.data();
+    uint64_t* __restrict__ valid = batch.valid.data();
+    uint64_t* __restrict__ seeds0 = batch.seeds[0].data();
+    uint64_t* __restrict__ seeds1 = batch.seeds[1].data();
+    NO_ALIAS_LOOP
+    for (std::size_t e=0; e<n; ++e) {
+        const uint64_t c = columns[e];
+        const uint64_t occupied = occupiedNibbles(c);
+        const uint64_t top = occupied & ~(occupied >> 4);
+        switch (command) {
+        case TAKE:
+            valid[e] = (held[e] == Board::EMPTY) & (occupied != 0);
+            newHeld[e] = nibbleAt(c, top);
+            column[e] = c & ~nibbleMask(top);
+            break;
+        case PUT: {
+            const uint64_t slot = (occupied << 4 | 1) & ~occupied & COLUMN_NIBBLES;
+            valid[e] = (held[e] != Board::EMPTY) & (slot != 0);
+            newHeld[e] = Board::EMPTY;
+            column[e] = c | (broadcastNibble(held[e]) & nibbleMask(slot));
+            seeds0[e] = slot;
+            break;
+        }
+        case SWAP: {
+            const uint64_t second = top >> 4;
+            valid[e] = second != 0;
+            newHeld[e] = held[e];
+            column[e] = (c & ~nibbleMask(top | second)) | (c & nibbleMask(top)) >> 4 | (c & nibbleMask(second)) << 4;
+            seeds0[e] = top;
+            seeds1[e] = second;
+            break;
+        }
+        }
+    }
+}
+
+// Bit parallel hasMatch for a moved cell of every board in the batch. A
+// component of at least four cells always has four within three steps of any
+// of its cells, so three rounds of growth are enough. Computed for every board
+// and masked by valid afterwards, so there is no branch in the loop.
+void markMatches(const Frontier& frontier, const uint8_t col, const std::vector<uint64_t>& seedsOf, Batch& batch) {
+    const std::size_t n = frontier.size();
+    const uint64_t* __restrict__ columns[Board::MAX_COLS];
+    // all ones for the moved column, in place of a branch on it
+    uint64_t isCol[Board::MAX_COLS];
+    for (uint8_t i=0; i<Board::MAX_COLS; ++i) {
+        columns[i] = frontier.columns[i].data();
+        isCol[i] = -uint64_t{i == col};
+    }
+    const uint64_t* __restrict__ column = batch.column.data();
+    const uint64_t* __restrict__ valid = batch.valid.data();
+    const uint64_t* __restrict__ seeds = seedsOf.data();
+    uint64_t* __restrict__ matched = batch.matched.data();
+    NO_ALIAS_LOOP
+    for (std::size_t e=0; e<n; ++e) {
+        const uint64_t item = nibbleAt(column[e], seeds[e]);
+        uint64_t equal[Board::MAX_COLS];
+        uint64_t reach[Board::MAX_COLS];
+        for (uint8_t i=0; i<Board::MAX_COLS; ++i) {
+            equal[i] = equalNibbles((column[e] & isCol[i]) | (columns[i][e] & ~isCol[i]), item);
+            reach[i] = seeds[e] & isCol[i];
+        }
+        for (int step=0; step<3; ++step) {
+            uint64_t next[Board::MAX_COLS];
+            for (uint8_t i=0; i<Board::MAX_COLS; ++i) {
+                const uint64_t left = i > 0 ? reach[i-1] : 0;
+                const uint64_t right = i+1 < Board::MAX_COLS ? reach[i+1] : 0;
+                next[i] = (reach[i] | reach[i]<<4 | reach[i]>>4 | left | right) & equal[i];
+            }
+            std::copy(next, next+Board::MAX_COLS, reach);
+        }
+        // at most 7 per nibble, so the nibbles don't carry
+        uint64_t cells = 0;
+        for (uint8_t i=0; i<Board::MAX_COLS; ++i) {
+            cells += reach[i];
+        }
+        const uint64_t need = (item & Board::BOMB_MASK) ? 2 : 4;
+        matched[e] |= valid[e] & (nibbleSum(cells) >= need);
+    }
+}
+
+template <uint8_t command>
+void expand(const Frontier& frontier, const uint8_t col, Batch& batch) {
+    batch.resize(frontier.size());
+    applyMove<command>(frontier, col, batch);
+    std::fill(batch.matched.begin(), batch.matched.end(), 0);
+    switch (command) {
+    case PUT:
+        markMatches(frontier, col, batch.seeds[0], batch);
+        break;
+    case SWAP:
+        markMatches(frontier, col, batch.seeds[0], batch);
+        markMatches(frontier, col, batch.seeds[1], batch);
+        break;
+    }
+}
+
+void reconstructMoves(const std::vector<Frontier>& plies, uint32_t index, Move last, std::vector<Move>& moves) {
+    moves.push_back(last);
+    for (std::size_t ply=plies.size(); ply-->1; ) {
+        moves.push_back(plies[ply].moves[index]);
+        index = plies[ply].parent[index];
+    }
+    std::reverse(moves.begin(), moves.end());
+}
+
+bool solveFrontier(const Board::PackedBoard& board, const int maxMaxMoves, std::vector<Move>& moves, const std::atomic<bool>* abort, std::size_t& nodes) {
+    std::vector<Frontier> plies(1);
+    uint64_t rootColumns[Board::MAX_COLS];
+    for (uint8_t i=0; i<Board::MAX_COLS; ++i) {
+        rootColumns[i] = board.column(i);
+    }
+    plies[0].push(rootColumns, board.held(), 0, {});
+    CacheType visited{1<<16};
+    visited.insert(board);
+    Batch batch;
+    for (int depth=1; depth<maxMaxMoves; ++depth) {
+        const Frontier& frontier = plies.back();
+        Frontier next;
+        for (const uint8_t command : {PUT, SWAP, TAKE}) {
+            for (uint8_t col=0; col<Board::MAX_COLS; ++col) {
+                if (abort && abort->load(std::memory_order_relaxed)) return false;
+                const Move move{command, col};
+                switch (command) {
+                case PUT:
+                    expand<PUT>(frontier, col, batch);
+                    break;
+                case SWAP:
+                    expand<SWAP>(frontier, col, batch);
+                    break;
+                case TAKE:
+                    expand<TAKE>(frontier, col, batch);
+                    break;
+                }
+                for (std::size_t e=0; e<frontier.size(); ++e) {
+                    if (batch.matched[e]) {
+                        nodes += visited.size();
+                        reconstructMoves(plies, e, move, moves);
+                        return true;
+                    }
+                }
+                for (std::size_t e=0; e<frontier.size(); ++e) {
+                    if (!batch.valid[e]) continue;
+                    uint64_t columns[Board::MAX_COLS];
+                    for (uint8_t i=0; i<Board::MAX_COLS; ++i) {
+                        columns[i] = i == col ? batch.column[e] : frontier.columns[i][e];
+                    }
+                    const Board::PackedBoard child = Board::PackedBoard::fromColumns(columns, batch.held[e]);
+                    if (visited.insert(child)) {
+                        next.push(columns, batch.held[e], e, move);
+                    }
+                }
+            }
+        }
+        if (next.size() == 0 || next.size() > MAX_FRONTIER) break;
+        plies.push_back(std::move(next));
+    }
+    nodes += visited.size();
+    return false;
+}
+
+bool solveDepthFirst(const Board::PackedBoard& board, const int maxMaxMoves, std::vector<Move>& moves, const std::atomic<bool>* abort, std::size_t& nodes) {
+    // no sequence of moves can match, so don't search every one up to maxMaxMoves
+    if (matchableItems(Board::unpack(board)) == 0) return false;
+    CacheType cache{1<<14};
+    for (int maxMoves=1; maxMoves<maxMaxMoves; ++maxMoves) {
+        cache.clear();
+        assert(moves.size() == 0);
+        const bool solved = solveImpl(board, moves, maxMoves, cache, abort);
+        nodes += cache.size();
+        if (solved) return true;
+        if (abort && abort->load(std::memory_order_relaxed)) return false;
+    }
+    return false;
+}
+
 void balanceBoard(const Board::Board& board, std::vector<Move>& moves) {
     Timer timer{"balanceBoard time"};
     Board::Board curBoard{board};
@@ -153,23 +692,136 @@ void makeMove(Board::Board& board, Move move) {
     throw std::runtime_error("makeMove");
 }
 
-void solve(const Board::Board& board, std::vector<Move>& moves) {
+int clearMatches(Board::Board& board) {
+    int clearedCount = 0;
+    while (true) {
+        bool visited[Board::MAX_COLS][Board::MAX_ROWS]{};
+        bool cleared[Board::MAX_COLS][Board::MAX_ROWS]{};
+        bool anyCleared = false;
+        for (uint8_t i=0; i<Board::MAX_COLS; ++i) {
+            for (uint8_t j=0; j<board.counts[i]; ++j) {
+                if (visited[i][j]) continue;
+                const uint8_t item = board.items[i][j];
+                bool component[Board::MAX_COLS][Board::MAX_ROWS]{};
+                const uint8_t size = matchSize(board, i, j, item, component);
+                const bool isMatch = size >= (Board::isBomb(item) ? 2 : 4);
+                anyCleared |= isMatch;
+                for (uint8_t ci=0; ci<Board::MAX_COLS; ++ci) {
+                    for (uint8_t cj=0; cj<board.counts[ci]; ++cj) {
+                        visited[ci][cj] |= component[ci][cj];
+                        if (!isMatch) continue;
+                        if (Board::isBomb(item)) {
+                            // a bomb pair wipes every block of its colour
+                            cleared[ci][cj] |= (board.items[ci][cj] & ~Board::BOMB_MASK) == (item & ~Board::BOMB_MASK);
+                        } else {
+                            cleared[ci][cj] |= component[ci][cj];
+                        }
+                    }
+                }
+            }
+        }
+        if (!anyCleared) return clearedCount;
+        for (uint8_t i=0; i<Board::MAX_COLS; ++i) {
+            uint8_t count = 0;
+            for (uint8_t j=0; j<board.counts[i]; ++j) {
+                if (!cleared[i][j]) {
+                    board.items[i][count++] = board.items[i][j];
+                }
+            }
+            clearedCount += board.counts[i] - count;
+            board.counts[i] = count;
+        }
+    }
+}
+
+Board::Board predictBoard(const Board::Board& board, const std::vector<Move>& moves) {
+    Board::Board ret{board};
+    for (const auto& move : moves) {
+        makeMove(ret, move);
+    }
+    clearMatches(ret);
+    return ret;
+}
+
+bool planMakesMatch(const Board::Board& board, const std::vector<Move>& moves) {
+    if (moves.empty()) return false;
+    Board::Board curBoard{board};
+    for (const auto& move : moves) {
+        const uint8_t i = move.col;
+        if (i >= Board::MAX_COLS) return false;
+        switch (move.command) {
+        case TAKE:
+            if (curBoard.counts[i] == 0 || curBoard.held != Board::EMPTY) return false;
+            break;
+        case PUT:
+            if (curBoard.counts[i] == Board::MAX_ROWS || curBoard.held == Board::EMPTY) return false;
+            break;
+        case SWAP:
+            if (curBoard.counts[i] < 2) return false;
+            break;
+        default:
+            return false;
+        }
+        makeMove(curBoard, move);
+    }
+    const Move& last = moves.back();
+    const uint8_t top = curBoard.counts[last.col];
+    switch (last.command) {
+    case PUT:
+        return hasMatch(curBoard, last.col, top-1);
+    case SWAP:
+        return hasMatch(curBoard, last.col, top-1) || hasMatch(curBoard, last.col, top-2);
+    }
+    return false;
+}
+
+void setEngine(Engine newEngine) {
+    engine = newEngine;
+}
+
+void solve(const Board::Board& board, std::vector<Move>& moves, const std::atomic<bool>* abort) {
     Timer timer{"solve time"};
     moves.clear();
     const int maxMaxMoves = itemCount(board) < 12 ? 7 : 10;
-    for (int maxMoves=1; maxMoves<maxMaxMoves; ++maxMoves) {
-        CacheType cache;
-        cache.reserve(100000);
-        assert(moves.size() == 0);
-        if (solveImpl(board, moves, maxMoves, cache)) {
+    std::size_t nodes = 0;
+    const Board::PackedBoard packed = Board::pack(board);
+    const bool solved = engine == Engine::FRONTIER
+        ? solveFrontier(packed, maxMaxMoves, moves, abort, nodes)
+        : solveDepthFirst(packed, maxMaxMoves, moves, abort, nodes);
+    std::cout << "solve nodes: " << nodes << '\n';
+    if (solved) return;
+    moves.clear();
+    if (abort && abort->load(std::memory_order_relaxed)) return;
+    balanceBoard(board, moves);
+}
+
+void solveForScore(const Board::Board& board, uint8_t phageCol, std::vector<Move>& moves, const std::atomic<bool>* abort) {
+    {
+        Timer timer{"solveForScore time"};
+        ScoreSearch search{board, abort};
+        std::vector<Move> curMoves;
+        curMoves.reserve(SCORE_MAX_MOVES);
+        scoreImpl(Board::pack(board), curMoves, phageCol, 0, search);
+        std::cout << "solveForScore nodes: " << search.nodes << " rate: " << search.bestRate << '\n';
+        if (abort && abort->load(std::memory_order_relaxed)) {
+            moves.clear();
             return;
         }
+        moves = search.bestMoves;
     }
-    if (moves.size() == 0) {
-        balanceBoard(board, moves);
-        if (moves.size()) {
-            return;
-        }
+    if (moves.empty()) {
+        solve(board, moves, abort);
+    }
+}
+
+void solveWithObjective(Objective objective, const Board::Board& board, uint8_t phageCol, std::vector<Move>& moves, const std::atomic<bool>* abort) {
+    switch (objective) {
+    case Objective::SURVIVE:
+        solve(board, moves, abort);
+        return;
+    case Objective::SCORE:
+        solveForScore(board, phageCol, moves, abort);
+        return;
     }
 }
 }}
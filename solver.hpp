@@ -1,6 +1,7 @@
 #ifndef SOLVER_HPP
 #define SOLVER_HPP
 
+#include <atomic>
 #include <cstdint>
 #include <vector>
 
@@ -13,6 +14,16 @@ const uint8_t TAKE = 0;
 const uint8_t PUT = 1;
 const uint8_t SWAP = 2;
 
+enum class Objective {
+    SURVIVE, // make any match in as few moves as possible
+    SCORE,   // make the match with the most points per second within a few moves
+};
+
+enum class Engine {
+    DEPTH_FIRST, // iterative deepening
+    FRONTIER,    // breadth first, one ply at a time
+};
+
 struct Move {
     uint8_t command;
     uint8_t col;
@@ -20,7 +31,19 @@ struct Move {
 
 void printMoves(const std::vector<Move>& moves);
 void makeMove(Board::Board& board, Move move);
-void solve(const Board::Board& board, std::vector<Move>& moves);
+// Removes every match on the board, repeating until no matches remain.
+// Returns the number of blocks cleared.
+int clearMatches(Board::Board& board);
+// The board expected once the game has consumed moves and cleared the match.
+Board::Board predictBoard(const Board::Board& board, const std::vector<Move>& moves);
+// True if moves are legal on board and the last one completes a match.
+bool planMakesMatch(const Board::Board& board, const std::vector<Move>& moves);
+void setEngine(Engine engine);
+// Setting abort makes solve return early with no moves.
+void solve(const Board::Board& board, std::vector<Move>& moves, const std::atomic<bool>* abort = nullptr);
+// phageCol is needed to weigh how long a plan takes to key in.
+void solveForScore(const Board::Board& board, uint8_t phageCol, std::vector<Move>& moves, const std::atomic<bool>* abort = nullptr);
+void solveWithObjective(Objective objective, const Board::Board& board, uint8_t phageCol, std::vector<Move>& moves, const std::atomic<bool>* abort = nullptr);
 
 }}
 
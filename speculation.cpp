@@ -0,0 +1,73 @@
+#include <iostream>
+
+#include "board.hpp"
+#include "realtime.hpp"
+#include "solver.hpp"
+#include "speculation.hpp"
+
+namespace HackMatch {
+namespace Speculation {
+namespace {
+// The game pushes a new row in at the top of every column, so everything we
+// predicted should have moved down by one.
+bool isPredictedWithNewRow(const Board::Board& predicted, const Board::Board& board) {
+    if (predicted.held != board.held) return false;
+    for (int i=0; i<Board::MAX_COLS; ++i) {
+        if (board.counts[i] != predicted.counts[i]+1) return false;
+        for (int j=0; j<predicted.counts[i]; ++j) {
+            if (board.items[i][j+1] != predicted.items[i][j]) return false;
+        }
+    }
+    return true;
+}
+}
+
+Speculator::Speculator(Solver::Objective objective) : objective(objective) {
+    predictedMoves.reserve(100);
+}
+
+Speculator::~Speculator() {
+    stop();
+}
+
+void Speculator::stop() {
+    if (thread.joinable()) {
+        abort = true;
+        thread.join();
+    }
+}
+
+void Speculator::start(const Board::Board& board, const std::vector<Solver::Move>& moves) {
+    stop();
+    if (moves.empty()) return;
+    predicted = Solver::predictBoard(board, moves);
+    const uint8_t predictedPhageCol = moves.back().col;
+    abort = false;
+    thread = std::thread([this, predictedPhageCol]{
+        Realtime::configureSolverThread();
+        Solver::solveWithObjective(objective, predicted, predictedPhageCol, predictedMoves, &abort);
+    });
+}
+
+bool Speculator::take(const Board::Board& board, std::vector<Solver::Move>& moves) {
+    if (!thread.joinable()) return false;
+    if (board == predicted) {
+        thread.join();
+        std::cout << "speculation hit\n";
+        moves = predictedMoves;
+        return true;
+    }
+    if (isPredictedWithNewRow(predicted, board)) {
+        thread.join();
+        // the new row is unknown to the plan, so only trust it if it still matches
+        if (Solver::planMakesMatch(board, predictedMoves)) {
+            std::cout << "speculation hit with new row\n";
+            moves = predictedMoves;
+            return true;
+        }
+        return false;
+    }
+    stop();
+    return false;
+}
+}}
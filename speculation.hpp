@@ -0,0 +1,31 @@
+#ifndef SPECULATION_HPP
+#define SPECULATION_HPP
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "board.hpp"
+#include "solver.hpp"
+
+namespace HackMatch {
+namespace Speculation {
+// Solves the board we expect to see next while the current plan is being keyed in.
+class Speculator {
+    const Solver::Objective objective;
+    std::thread thread;
+    std::atomic<bool> abort{false};
+    Board::Board predicted{};
+    std::vector<Solver::Move> predictedMoves;
+    void stop();
+public:
+    explicit Speculator(Solver::Objective objective);
+    ~Speculator();
+    Speculator(const Speculator&) = delete;
+    Speculator& operator=(const Speculator&) = delete;
+    void start(const Board::Board& board, const std::vector<Solver::Move>& moves);
+    // Returns true and fills moves if board is the one we speculated on.
+    bool take(const Board::Board& board, std::vector<Solver::Move>& moves);
+};
+}}
+#endif
@@ -0,0 +1,162 @@
+#include <chrono>
+#include <iostream>
+#include <optional>
+#include <thread>
+
+#include "board.hpp"
+#include "solver.hpp"
+#include "verifier.hpp"
+#include "x11_handling.hpp"
+
+namespace HackMatch {
+namespace Verifier {
+namespace {
+const auto POLL_INTERVAL = std::chrono::milliseconds(2);
+// a few frames for the game to react to a key
+const auto CONFIRM_TIMEOUT = std::chrono::milliseconds(17*4);
+// the clear animation after a match, on top of reacting to the key
+const auto SETTLE_TIMEOUT = CONFIRM_TIMEOUT + std::chrono::milliseconds(17*4+3);
+const int MAX_RESENDS = 1;
+
+struct Observed {
+    X11Handling::PhageState phage;
+    X11Handling::ColumnTop column;
+};
+
+X11Handling::ColumnTop columnTop(const Board::Board& board, uint8_t col) {
+    const uint8_t count = board.counts[col];
+    return {count > 0 ? board.items[col][count-1] : Board::EMPTY,
+            count > 1 ? board.items[col][count-2] : Board::EMPTY};
+}
+
+bool agrees(const Observed& observed, const Board::Board& expected, uint8_t col, bool checkColumn) {
+    if (observed.phage.phageCol != col) return false;
+    if (observed.phage.held != expected.held) return false;
+    if (!checkColumn) return true;
+    const X11Handling::ColumnTop top = columnTop(expected, col);
+    return observed.column.top == top.top && observed.column.second == top.second;
+}
+
+std::optional<Observed> observe(Display* display, Window window, uint8_t col, bool checkColumn) {
+    const auto phage = X11Handling::loadPhageStateFromWindow(display, window);
+    if (!phage) return {};
+    Observed ret{*phage, {Board::EMPTY, Board::EMPTY}};
+    if (checkColumn) {
+        const auto column = X11Handling::loadColumnTopFromWindow(display, window, col);
+        if (!column) return {};
+        ret.column = *column;
+    }
+    return ret;
+}
+
+// Polls until the game shows expected. Returns the last observation either way.
+std::optional<Observed> waitFor(Display* display, Window window, const Board::Board& expected, uint8_t col, bool checkColumn, std::chrono::milliseconds timeout) {
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (true) {
+        const auto observed = observe(display, window, col, checkColumn);
+        if (observed && agrees(*observed, expected, col, checkColumn)) return observed;
+        if (std::chrono::steady_clock::now() >= deadline) return observed;
+        std::this_thread::sleep_for(POLL_INTERVAL);
+    }
+}
+
+std::optional<uint8_t> waitForPhage(Display* display, Window window, uint8_t col) {
+    const auto deadline = std::chrono::steady_clock::now() + CONFIRM_TIMEOUT;
+    while (true) {
+        const auto phage = X11Handling::loadPhageStateFromWindow(display, window);
+        if (phage && phage->phageCol == col) return col;
+        if (std::chrono::steady_clock::now() >= deadline) {
+            if (phage) return phage->phageCol;
+            return {};
+        }
+        std::this_thread::sleep_for(POLL_INTERVAL);
+    }
+}
+
+bool movePhage(Display* display, Window window, uint8_t& phageCol, uint8_t col) {
+    for (int attempt=0; attempt<=MAX_RESENDS; ++attempt) {
+        if (phageCol == col) return true;
+        while (col > phageCol) {
+            X11Handling::moveRight(display);
+            ++phageCol;
+        }
+        while (col < phageCol) {
+            X11Handling::moveLeft(display);
+            --phageCol;
+        }
+        const auto observed = waitForPhage(display, window, col);
+        if (!observed) {
+            std::cout << "lost phage while moving to column " << static_cast<int>(col) << '\n';
+            return false;
+        }
+        if (*observed == col) return true;
+        std::cout << "phage at column " << static_cast<int>(*observed) << ", expected " << static_cast<int>(col) << '\n';
+        X11Handling::slowDown(X11Handling::KeyAction::MOVE);
+        phageCol = *observed;
+    }
+    return false;
+}
+
+void sendCommand(Display* display, uint8_t command) {
+    switch (command) {
+    case Solver::PUT:
+        X11Handling::tractorBeam(display);
+        return;
+    case Solver::TAKE:
+        X11Handling::tractorBeam(display);
+        return;
+    case Solver::SWAP:
+        X11Handling::swap(display);
+        return;
+    }
+    std::cerr << "bad command in solution: " << static_cast<int>(command) << '\n';
+    throw std::runtime_error("bad command in solution");
+}
+}
+
+bool waitForState(Display* display, Window window, const Board::Board& expected, uint8_t col, bool checkColumn, std::chrono::milliseconds timeout) {
+    const auto observed = waitFor(display, window, expected, col, checkColumn, timeout);
+    return observed && agrees(*observed, expected, col, checkColumn);
+}
+
+bool executePlan(Display* display, Window window, const Board::Board& board, uint8_t phageCol, const std::vector<Solver::Move>& moves) {
+    const bool planMatches = Solver::planMakesMatch(board, moves);
+    Board::Board before{board};
+    for (std::size_t moveIndex=0; moveIndex<moves.size(); ++moveIndex) {
+        const Solver::Move& move = moves[moveIndex];
+        if (!movePhage(display, window, phageCol, move.col)) return false;
+        Board::Board after{before};
+        Solver::makeMove(after, move);
+        // the last move of a matching plan is only done once its match has cleared
+        const bool clears = planMatches && moveIndex+1 == moves.size();
+        if (clears) {
+            Solver::clearMatches(after);
+        }
+        // held alone confirms TAKE and PUT, a SWAP only shows in the column
+        const bool checkColumn = clears || move.command == Solver::SWAP;
+        const auto timeout = clears ? SETTLE_TIMEOUT : CONFIRM_TIMEOUT;
+        bool confirmed = false;
+        for (int attempt=0; attempt<=MAX_RESENDS && !confirmed; ++attempt) {
+            sendCommand(display, move.command);
+            const auto observed = waitFor(display, window, after, move.col, checkColumn, timeout);
+            if (!observed) {
+                std::cout << "lost the board after command\n";
+                return false;
+            }
+            confirmed = agrees(*observed, after, move.col, checkColumn);
+            if (!confirmed && !agrees(*observed, before, move.col, checkColumn)) {
+                // something other than a dropped key happened, e.g. a new row came in
+                std::cout << "unexpected state after command, replanning\n";
+                return false;
+            }
+            if (!confirmed) {
+                std::cout << "command dropped, resending\n";
+                X11Handling::slowDown(move.command == Solver::SWAP ? X11Handling::KeyAction::SWAP : X11Handling::KeyAction::TRACTOR_BEAM);
+            }
+        }
+        if (!confirmed) return false;
+        before = after;
+    }
+    return true;
+}
+}}
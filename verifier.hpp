@@ -0,0 +1,24 @@
+#ifndef VERIFIER_HPP
+#define VERIFIER_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include <X11/Xlib.h>
+
+#include "board.hpp"
+#include "solver.hpp"
+
+namespace HackMatch {
+namespace Verifier {
+// Polls until the phage is at col holding expected.held and, with checkColumn,
+// col's top two items are expected's. Returns false on timeout.
+bool waitForState(Display* display, Window window, const Board::Board& expected, uint8_t col, bool checkColumn, std::chrono::milliseconds timeout);
+// Keys in moves for board with the phage starting at phageCol, confirming
+// after each command that the game did what makeMove says it should.
+// A dropped key is resent once; returns false if the game still disagrees,
+// in which case the board should be captured again and replanned.
+bool executePlan(Display* display, Window window, const Board::Board& board, uint8_t phageCol, const std::vector<Solver::Move>& moves);
+}}
+#endif
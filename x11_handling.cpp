@@ -1,13 +1,17 @@
+#include <algorithm>
 #include <cassert>
 #include <chrono>
 #include <cstring>
+#include <fstream>
 #include <iostream>
+#include <iterator>
 #include <memory>
 #include <optional>
 #include <thread>
 #include <vector>
 
 #include <X11/X.h>
+#include <X11/Xatom.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/extensions/XTest.h>
@@ -21,7 +25,11 @@ namespace X11Handling {
 namespace {
 const int PIXEL_FUZZ = 3;  // If your bot has trouble seeing the blocks, increase the fuzz.  Maximum practical value is around 22.
 const char *EXAPUNKS_WINDOW_NAME = "EXAPUNKS";
+// remembers the window between runs, so startup usually needs no search
+const char *WINDOW_CACHE_PATH = "hackmatch_window.txt";
 const auto KEY_DELAY = std::chrono::milliseconds(17);
+const auto SLOW_DOWN_STEP = std::chrono::milliseconds(2);
+const auto MAX_KEY_DELAY = 2*KEY_DELAY;
 const int ASSUMED_WINDOW_WIDTH = 1600;
 const int ASSUMED_WINDOW_HEIGHT = 900;
 const int ASSUMED_XIMAGE_BYTE_ORDER = LSBFirst;
@@ -29,8 +37,10 @@ const int ASSUMED_XIMAGE_BITMAP_UNIT = 32;
 const int ASSUMED_XIMAGE_BITMAP_BIT_ORDER = LSBFirst;
 const int ASSUMED_XIMAGE_BITMAP_PAD = 32;
 const int ASSUMED_XIMAGE_DEPTH = 24;
-const int ASSUMED_XIMAGE_BYTES_PER_LINE_FULL_WINDOW = 6400;
 const int ASSUMED_XIMAGE_BITS_PER_PIXEL = 32;
+// validateAssumptions only grabs this corner of the window
+const int VALIDATION_SIZE = 30;
+const int ASSUMED_XIMAGE_BYTES_PER_LINE_VALIDATION = VALIDATION_SIZE * ASSUMED_XIMAGE_BITS_PER_PIXEL/8;
 const int ASSUMED_XIMAGE_RED_MASK = 16711680;
 const int ASSUMED_XIMAGE_GREEN_MASK = 65280;
 const int ASSUMED_XIMAGE_BLUE_MASK = 255;
@@ -49,6 +59,10 @@ const int PHAGE_PINK_DATA_X_OFFSET = 392 - BOARD_X_OFFSET;
 const int PHAGE_PINK_DATA_Y_OFFSET = 741 - BOARD_Y_OFFSET;
 const int PHAGE_SILVER_DATA_X_OFFSET = 385 - BOARD_X_OFFSET;
 const int PHAGE_SILVER_DATA_Y_OFFSET = 694 - BOARD_Y_OFFSET;
+// rows from the top of the phage down to the held item, enough to read both phage column and held
+const int PHAGE_STRIP_Y_OFFSET = PHAGE_SILVER_DATA_Y_OFFSET;
+const int PHAGE_STRIP_HEIGHT = PHAGE_HELD_Y_OFFSET + 1 - PHAGE_STRIP_Y_OFFSET;
+static_assert(PHAGE_PINK_DATA_Y_OFFSET < PHAGE_HELD_Y_OFFSET);
 
 constexpr uint32_t rgbToPixel(int r, int g, int b) {
     return (r << 16) + (g << 8) + b;
@@ -75,6 +89,9 @@ const uint8_t BLUE_DATA[] = {130, 57, 32, 0, 130, 57, 32, 0, 130, 57, 32, 0, 130
 //const uint8_t YELLOW_BOMB_DATA[] = {0, 29, 27, 8, 0, 29, 27, 8, 0, 29, 27, 7, 0, 29, 27, 7, 0, 29, 27, 7, 0, 29, 27, 7, 0, 29, 27, 7, 0, 29, 27, 7, 0, 29, 27, 7, 0, 29, 27, 7};
 //const uint8_t BLUE_BOMB_DATA[] = {0, 9, 5, 51, 0, 9, 4, 51, 0, 9, 4, 51, 0, 9, 4, 51, 0, 9, 4, 51, 0, 9, 4, 51, 0, 9, 4, 51, 0, 9, 4, 51, 0, 9, 4, 51, 0, 9, 4, 51};
 
+// width of the pixel run dataOffsettedToItem compares
+const int ITEM_SAMPLE_WIDTH = sizeof(YELLOW_DATA)/BYTES_PER_PIXEL;
+
 const uint8_t PHAGE_SILVER_DATA[] = {255, 255, 228, 0, 255, 255, 228, 0, 255, 255, 229, 0, 255, 255, 229, 0, 255, 255, 229, 0, 255, 255, 228, 0};
 const uint8_t PHAGE_PINK_DATA[] = {122, 14, 178, 0, 148, 8, 221, 0, 149, 4, 222, 0, 150, 0, 224, 0, 150, 0, 224, 0, 150, 0, 224, 0, 150, 0, 224, 0, 149, 4, 222, 0};
 
@@ -121,13 +138,100 @@ std::optional<Window> getExapunksWindowImpl(Display *display, Window curWindow)
     return {};
 }
 
-void sendKey(Display* display, KeyCode keyCode) {
+KeyTiming keyTimings[std::size(KEY_ACTIONS)] = {{KEY_DELAY, KEY_DELAY}, {KEY_DELAY, KEY_DELAY}, {KEY_DELAY, KEY_DELAY}};
+
+// Catches X errors, such as BadWindow from a stale cached window, instead of exiting.
+class XErrorTrap {
+    static bool failed;
+    XErrorHandler previous;
+    static int handler(Display*, XErrorEvent*) {
+        failed = true;
+        return 0;
+    }
+public:
+    XErrorTrap() : previous(XSetErrorHandler(handler)) {
+        failed = false;
+    }
+    ~XErrorTrap() {
+        XSetErrorHandler(previous);
+    }
+    bool ok(Display* display) const {
+        XSync(display, False);
+        return !failed;
+    }
+};
+bool XErrorTrap::failed = false;
+
+bool hasName(Display *display, Window window, const char *name) {
+    char *windowName;
+    if (XFetchName(display, window, &windowName) == 0) return false;
+    XFreeWrapper wrap{windowName};
+    return !strcmp(name, windowName);
+}
+
+bool hasClass(Display *display, Window window, const char *name) {
+    XClassHint classHint;
+    if (XGetClassHint(display, window, &classHint) == 0) return false;
+    XFreeWrapper wrapName{classHint.res_name};
+    XFreeWrapper wrapClass{classHint.res_class};
+    return !strcmp(name, classHint.res_class) || !strcmp(name, classHint.res_name);
+}
+
+bool isExapunksWindow(Display *display, Window window) {
+    return hasClass(display, window, EXAPUNKS_WINDOW_NAME) || hasName(display, window, EXAPUNKS_WINDOW_NAME);
+}
+
+std::optional<Window> loadCachedWindow(Display *display) {
+    std::ifstream in{WINDOW_CACHE_PATH};
+    Window window;
+    if (!(in >> window)) return {};
+    XErrorTrap trap;
+    const bool found = isExapunksWindow(display, window);
+    if (!trap.ok(display) || !found) return {};
+    return {window};
+}
+
+void saveCachedWindow(Window window) {
+    std::ofstream out{WINDOW_CACHE_PATH};
+    out << window << '\n';
+}
+
+// Asks the window manager for its top level windows, rather than walking the whole tree.
+std::optional<Window> getExapunksWindowFromClientList(Display *display) {
+    const Atom clientList = XInternAtom(display, "_NET_CLIENT_LIST", True);
+    if (clientList == None) return {};
+    Atom actualType;
+    int actualFormat;
+    unsigned long nItems;
+    unsigned long bytesAfter;
+    unsigned char *data = nullptr;
+    const int status = XGetWindowProperty(display, XDefaultRootWindow(display), clientList, 0, ~0L, False, XA_WINDOW,
+            &actualType, &actualFormat, &nItems, &bytesAfter, &data);
+    if (status != Success || data == nullptr) return {};
+    XFreeWrapper wrap{data};
+    if (actualType != XA_WINDOW || actualFormat != 32) return {};
+    // format 32 properties come back as longs
+    const Window *windows = reinterpret_cast<const Window*>(data);
+    for (unsigned long i=0; i<nItems; ++i) {
+        if (isExapunksWindow(display, windows[i])) {
+            return {windows[i]};
+        }
+    }
+    return {};
+}
+
+LatencyHistogram keyOvershoot;
+
+void sendKey(Display* display, KeyCode keyCode, KeyAction action) {
+    const KeyTiming& timing = keyTimings[static_cast<int>(action)];
+    const auto t0 = std::chrono::steady_clock::now();
     XTestFakeKeyEvent(display, keyCode, True, 0);
     XSync(display, False);
-    std::this_thread::sleep_for(KEY_DELAY);
+    std::this_thread::sleep_for(timing.press);
     XTestFakeKeyEvent(display, keyCode, False, 0);
     XSync(display, False);
-    std::this_thread::sleep_for(KEY_DELAY);
+    std::this_thread::sleep_for(timing.release);
+    keyOvershoot.record(std::chrono::steady_clock::now() - t0 - timing.press - timing.release);
 }
 
 XImage* screenShotGame(Display* display, Window window) {
@@ -219,22 +323,39 @@ std::optional<int> findGameYOffset(char* data) {
     return {};
 }
 
-std::optional<uint8_t> findPhageColumn(char* data) {
+// dataY is the board y coordinate of the first row in data, for images of just the phage strip.
+std::optional<uint8_t> phageColumn(char* data, int dataY) {
     for (uint8_t col=0; col<Board::MAX_COLS; ++col) {
-        const std::size_t offset = pixelCoordToDataOffset(col*ITEM_SIZE + PHAGE_SILVER_DATA_X_OFFSET, PHAGE_SILVER_DATA_Y_OFFSET);
+        const std::size_t offset = pixelCoordToDataOffset(col*ITEM_SIZE + PHAGE_SILVER_DATA_X_OFFSET, PHAGE_SILVER_DATA_Y_OFFSET - dataY);
         if (imgcmp(data+offset, PHAGE_SILVER_DATA, sizeof(PHAGE_SILVER_DATA)) == 0) {
             return {col};
         }
     }
-    std::cout << "failed to find phage, probably crouched\n";
     return {};
 }
 
+std::optional<uint8_t> findPhageColumn(char* data) {
+    const auto ret = phageColumn(data, 0);
+    if (!ret) {
+        std::cout << "failed to find phage, probably crouched\n";
+    }
+    return ret;
+}
+
+uint8_t heldItem(char* data, const uint8_t phageCol, int dataY) {
+    const std::size_t heldOffset = pixelCoordToDataOffset(phageCol*ITEM_SIZE + PIXEL_X_OFFSET, PHAGE_HELD_Y_OFFSET - dataY);
+    return dataOffsettedToItem(data+heldOffset);
+}
+
+// The pink phage data is only visible when it holds nothing.
+bool phagePinkVisible(char* data, const uint8_t phageCol, int dataY) {
+    const std::size_t pinkOffset = pixelCoordToDataOffset(phageCol*ITEM_SIZE + PHAGE_PINK_DATA_X_OFFSET, PHAGE_PINK_DATA_Y_OFFSET - dataY);
+    return 0 == imgcmp(data+pinkOffset, PHAGE_PINK_DATA, sizeof(PHAGE_PINK_DATA));
+}
+
 uint8_t findHeld(char* data, const uint8_t phageCol) {
-    const std::size_t heldOffset = pixelCoordToDataOffset(phageCol*ITEM_SIZE + PIXEL_X_OFFSET, PHAGE_HELD_Y_OFFSET);
-    const uint8_t held = dataOffsettedToItem(data+heldOffset);
-    const std::size_t pinkOffset = pixelCoordToDataOffset(phageCol*ITEM_SIZE + PHAGE_PINK_DATA_X_OFFSET, PHAGE_PINK_DATA_Y_OFFSET);
-    const bool foundPink = 0 == imgcmp(data+pinkOffset, PHAGE_PINK_DATA, sizeof(PHAGE_PINK_DATA));
+    const uint8_t held = heldItem(data, phageCol, 0);
+    const bool foundPink = phagePinkVisible(data, phageCol, 0);
     assert(foundPink == (held == Board::EMPTY));
     return held;
 }
@@ -242,15 +363,25 @@ uint8_t findHeld(char* data, const uint8_t phageCol) {
 }
 
 Window getExapunksWindow(Display *display) {
-    Window rootWindow = XDefaultRootWindow(display);
-    auto ret = getExapunksWindowImpl(display, rootWindow);
+    Timer timer{"getExapunksWindow time"};
+    if (const auto cached = loadCachedWindow(display)) {
+        return *cached;
+    }
+    auto ret = getExapunksWindowFromClientList(display);
+    if (!ret) {
+        std::cout << "exapunks not in _NET_CLIENT_LIST, searching window tree\n";
+        Window rootWindow = XDefaultRootWindow(display);
+        ret = getExapunksWindowImpl(display, rootWindow);
+    }
     if (ret) {
+        saveCachedWindow(*ret);
         return *ret;
     }
     throw std::runtime_error("failed to get exapunks window");
 }
 
 void validateAssumptions(Display *display, Window window) {
+    Timer timer{"validateAssumptions time"};
     XWindowAttributes xWindowAttributes;
     Status status = XGetWindowAttributes(display, window, &xWindowAttributes);
     if (status == 0) {
@@ -269,7 +400,8 @@ void validateAssumptions(Display *display, Window window) {
         throw std::runtime_error("bad window size");
     }
 
-    XImage *xImage = XGetImage(display, window, 0, 0, ASSUMED_WINDOW_WIDTH, ASSUMED_WINDOW_HEIGHT, AllPlanes, ZPixmap);
+    // the format is the same for any size of image, so a small one will do
+    XImage *xImage = XGetImage(display, window, 0, 0, VALIDATION_SIZE, VALIDATION_SIZE, AllPlanes, ZPixmap);
     if (xImage == nullptr) {
         throw std::runtime_error("failed to XGetimage");
     }
@@ -294,8 +426,8 @@ void validateAssumptions(Display *display, Window window) {
         std::cerr << "depth is: " << xImage->depth << ", but was assumed to be: " << ASSUMED_XIMAGE_DEPTH << '\n';
         error = true;
     }
-    if (xImage->bytes_per_line != ASSUMED_XIMAGE_BYTES_PER_LINE_FULL_WINDOW) {
-        std::cerr << "bytes_per_line is: " << xImage->bytes_per_line << ", but was assumed to be: " << ASSUMED_XIMAGE_BYTES_PER_LINE_FULL_WINDOW << '\n';
+    if (xImage->bytes_per_line != ASSUMED_XIMAGE_BYTES_PER_LINE_VALIDATION) {
+        std::cerr << "bytes_per_line is: " << xImage->bytes_per_line << ", but was assumed to be: " << ASSUMED_XIMAGE_BYTES_PER_LINE_VALIDATION << '\n';
         error = true;
     }
     if (xImage->bits_per_pixel != ASSUMED_XIMAGE_BITS_PER_PIXEL) {
@@ -326,14 +458,14 @@ void validateAssumptions(Display *display, Window window) {
 //      throw std::runtime_error("bad XImage format");
 //  }
 
-    for (int y=0; y<30; ++y) {
-        for (int x=0; x<30; ++x) {
+    for (int y=0; y<VALIDATION_SIZE; ++y) {
+        for (int x=0; x<VALIDATION_SIZE; ++x) {
             const unsigned long correctPixel = XGetPixel(xImage, x, y);
             const int correctRed = (correctPixel & ASSUMED_XIMAGE_RED_MASK) >> 16;
             const int correctGreen = (correctPixel & ASSUMED_XIMAGE_GREEN_MASK) >> 8;
             const int correctBlue = (correctPixel & ASSUMED_XIMAGE_BLUE_MASK);
 
-            const std::size_t dataOffset = ASSUMED_XIMAGE_BYTES_PER_LINE_FULL_WINDOW * y + (ASSUMED_XIMAGE_BITS_PER_PIXEL/8) * x;
+            const std::size_t dataOffset = ASSUMED_XIMAGE_BYTES_PER_LINE_VALIDATION * y + (ASSUMED_XIMAGE_BITS_PER_PIXEL/8) * x;
             uint32_t testPixel;
             memcpy(&testPixel, xImage->data + dataOffset, sizeof(testPixel));
             const int testRed = (testPixel & xImage->red_mask) >> 16;
@@ -359,6 +491,7 @@ void validateAssumptions(Display *display, Window window) {
 }
 
 void activateWindow(Display *display, Window window) {
+    Timer timer{"activateWindow time"};
     XSetInputFocus(display, window, RevertToNone, CurrentTime);
     XRaiseWindow(display, window);
     XSync(display, False);
@@ -393,22 +526,107 @@ std::optional<PhageAndBoard> loadPhageAndBoardFromWindow(Display *display, Windo
     return {phageAndBoard};
 }
 
+std::optional<PhageState> loadPhageStateFromWindow(Display *display, Window window) {
+    XImage *xImage = XGetImage(display, window, BOARD_X_OFFSET, BOARD_Y_OFFSET + PHAGE_STRIP_Y_OFFSET, BOARD_PIXEL_WIDTH, PHAGE_STRIP_HEIGHT, AllPlanes, ZPixmap);
+    if (xImage == nullptr) {
+        throw std::runtime_error("failed to XGetimage");
+    }
+    XDestroyImageWrapper wrap{xImage};
+    const auto phageCol = phageColumn(xImage->data, PHAGE_STRIP_Y_OFFSET);
+    if (!phageCol) {
+        return {};
+    }
+    const uint8_t held = heldItem(xImage->data, *phageCol, PHAGE_STRIP_Y_OFFSET);
+    if (phagePinkVisible(xImage->data, *phageCol, PHAGE_STRIP_Y_OFFSET) != (held == Board::EMPTY)) {
+        // caught mid animation
+        return {};
+    }
+    return {{*phageCol, held}};
+}
+
+std::optional<ColumnTop> loadColumnTopFromWindow(Display *display, Window window, uint8_t col) {
+    const int x = BOARD_X_OFFSET + col*ITEM_SIZE + PIXEL_X_OFFSET;
+    XImage *xImage = XGetImage(display, window, x, BOARD_Y_OFFSET, ITEM_SAMPLE_WIDTH, BOARD_PIXEL_HEIGHT, AllPlanes, ZPixmap);
+    if (xImage == nullptr) {
+        throw std::runtime_error("failed to XGetimage");
+    }
+    XDestroyImageWrapper wrap{xImage};
+    // anchor the sample rows on the lowest non-bomb item, as findGameYOffset does, since bomb
+    // sprites first read as an item at a different row than the colours
+    std::optional<int> yOffset;
+    for (int y=BOARD_PIXEL_HEIGHT_ITEMS; y-->0 && !yOffset; ) {
+        const uint8_t item = dataOffsettedToItem(xImage->data + y*xImage->bytes_per_line);
+        if (item != Board::EMPTY && !Board::isBomb(item)) {
+            yOffset = y % ITEM_SIZE;
+        }
+    }
+    if (!yOffset) {
+        // nothing but bombs in this column, fall back to anchoring on the whole board
+        XImage *board = screenShotGame(display, window);
+        XDestroyImageWrapper wrapBoard{board};
+        yOffset = findGameYOffset(board->data);
+        if (!yOffset) {
+            return {};
+        }
+    }
+    ColumnTop ret{Board::EMPTY, Board::EMPTY};
+    for (int j=0; j<Board::MAX_ROWS; ++j) {
+        const int y = j*ITEM_SIZE + *yOffset;
+        const uint8_t item = dataOffsettedToItem(xImage->data + y*xImage->bytes_per_line);
+        if (item == Board::EMPTY) break;
+        ret.second = ret.top;
+        ret.top = item;
+    }
+    return {ret};
+}
+
+const char* keyActionName(KeyAction action) {
+    switch (action) {
+    case KeyAction::MOVE:
+        return "move";
+    case KeyAction::SWAP:
+        return "swap";
+    case KeyAction::TRACTOR_BEAM:
+        return "tractor_beam";
+    }
+    throw std::runtime_error("bad key action");
+}
+
+KeyTiming getKeyTiming(KeyAction action) {
+    return keyTimings[static_cast<int>(action)];
+}
+
+void setKeyTiming(KeyAction action, KeyTiming timing) {
+    keyTimings[static_cast<int>(action)] = timing;
+}
+
+void slowDown(KeyAction action) {
+    KeyTiming& timing = keyTimings[static_cast<int>(action)];
+    timing.press = std::min(timing.press + SLOW_DOWN_STEP, MAX_KEY_DELAY);
+    timing.release = std::min(timing.release + SLOW_DOWN_STEP, MAX_KEY_DELAY);
+    std::cout << keyActionName(action) << " timing now " << timing.press.count() << "ms/" << timing.release.count() << "ms\n";
+}
+
+const LatencyHistogram& sendKeyOvershoot() {
+    return keyOvershoot;
+}
+
 void moveLeft(Display* display) {
     KeyCode keyCodeS = XKeysymToKeycode(display, XK_s);
-    sendKey(display, keyCodeS);
+    sendKey(display, keyCodeS, KeyAction::MOVE);
 }
 
 void moveRight(Display* display) {
     KeyCode keyCodeF = XKeysymToKeycode(display, XK_f);
-    sendKey(display, keyCodeF);
+    sendKey(display, keyCodeF, KeyAction::MOVE);
 }
 void swap(Display* display) {
     KeyCode keyCodeK = XKeysymToKeycode(display, XK_k);
-    sendKey(display, keyCodeK);
+    sendKey(display, keyCodeK, KeyAction::SWAP);
 }
 
 void tractorBeam(Display *display) {
     KeyCode keyCodeJ = XKeysymToKeycode(display, XK_j);
-    sendKey(display, keyCodeJ);
+    sendKey(display, keyCodeJ, KeyAction::TRACTOR_BEAM);
 }
 }}
@@ -1,11 +1,13 @@
 #ifndef X11_HANDLING_HPP
 #define X11_HANDLING_HPP
 
+#include <chrono>
 #include <optional>
 
 #include <X11/Xlib.h>
 
 #include "board.hpp"
+#include "common.hpp"
 
 namespace HackMatch {
 namespace X11Handling {
@@ -14,10 +16,44 @@ struct PhageAndBoard {
     Board::Board board;
 };
 
+struct PhageState {
+    uint8_t phageCol;
+    uint8_t held;
+};
+
+// The two items nearest the phage in a column, EMPTY where there are none.
+struct ColumnTop {
+    uint8_t top;
+    uint8_t second;
+};
+
+enum class KeyAction {
+    MOVE,
+    SWAP,
+    TRACTOR_BEAM,
+};
+const KeyAction KEY_ACTIONS[] = {KeyAction::MOVE, KeyAction::SWAP, KeyAction::TRACTOR_BEAM};
+
+// How long a key is held down, and how long we wait after letting go.
+struct KeyTiming {
+    std::chrono::milliseconds press;
+    std::chrono::milliseconds release;
+};
+
 Window getExapunksWindow(Display* display);
 void validateAssumptions(Display* display, Window window);
 void activateWindow(Display* display, Window window);
 std::optional<PhageAndBoard> loadPhageAndBoardFromWindow(Display* display, Window window);
+// Cheap captures for checking that a key was taken, each reading only a thin strip of the window.
+std::optional<PhageState> loadPhageStateFromWindow(Display* display, Window window);
+std::optional<ColumnTop> loadColumnTopFromWindow(Display* display, Window window, uint8_t col);
+const char* keyActionName(KeyAction action);
+KeyTiming getKeyTiming(KeyAction action);
+void setKeyTiming(KeyAction action, KeyTiming timing);
+// Lengthens an action's timing after the game missed one of its keys.
+void slowDown(KeyAction action);
+// How far past its requested delays each key took.
+const LatencyHistogram& sendKeyOvershoot();
 void moveLeft(Display* display);
 void moveRight(Display* display);
 void swap(Display* display);